@@ -0,0 +1,124 @@
+// Checks the Direct Sound path (timer 0 -> FIFO A <- DMA1 from ROM), runs on a Linux host.
+//
+//   SRC="$(find src/nanoboyadvance/core -name '*.cpp') src/nanoboyadvance/util/logger.cpp src/nanoboyadvance/util/scaler.cpp src/nanoboyadvance/util/file.cpp src/nanoboyadvance/util/blipbuffer.cpp"
+//   g++ -O2 -std=gnu++17 -Isrc/nanoboyadvance -o fifo_check bench/fifo_check.cpp $SRC -pthread
+//   ./fifo_check [frames]
+//
+// A tiny BIOS sets up the sound hardware the way games do and idles. The check
+// runs in slices shorter than one sample and peeks at the head of a copy of
+// FIFO A after each, so every byte the APU pulls has to be the next byte of
+// the ROM, in order, with none dropped or repeated.
+//
+// Lives outside of src/ so the PROS build does not pick it up.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include "core/system/gba/emulator.hpp"
+
+using namespace Core;
+
+namespace {
+    // ARM code at 0x00000000
+    const u32 s_bios[] = {
+        0xEA000006, 0xEA000005, 0xEA000004, 0xEA000003, // exception vectors: b reset
+        0xEA000002, 0xEA000001, 0xEA000000, 0xEAFFFFFF,
+        0xE3A00301, // reset: mov   r0, #0x04000000
+        0xE3A01080, //        mov   r1, #0x80
+        0xE1C018B4, //        strh  r1, [r0, #0x84]    SOUNDCNT_X: master enable
+        0xE59F1038, //        ldr   r1, =0x0B04
+        0xE1C018B2, //        strh  r1, [r0, #0x82]    SOUNDCNT_H: FIFO A 100%, both sides, timer 0, reset
+        0xE3A01302, //        mov   r1, #0x08000000
+        0xE58010BC, //        str   r1, [r0, #0xBC]    DMA1SAD: ROM
+        0xE28010A0, //        add   r1, r0, #0xA0
+        0xE58010C0, //        str   r1, [r0, #0xC0]    DMA1DAD: FIFO_A
+        0xE59F1024, //        ldr   r1, =0xB640
+        0xE1C01CB6, //        strh  r1, [r0, #0xC6]    DMA1CNT_H: enable, special, 32-bit, repeat
+        0xE2802C01, //        add   r2, r0, #0x100
+        0xE3A01CFE, //        mov   r1, #0xFE00
+        0xE1C210B0, //        strh  r1, [r2]           TM0CNT_L: 512 cycles per sample
+        0xE3A01080, //        mov   r1, #0x80
+        0xE1C210B2, //        strh  r1, [r2, #2]       TM0CNT_H: start
+        0xE3A06000, //        mov   r6, #0
+        0xE2866001, // loop:  add   r6, r6, #1
+        0xEAFFFFFD, //        b     loop
+        0x00000B04, 0x0000B640 // literal pool
+    };
+
+    const char* s_bios_path = "fifo_check_bios.bin";
+
+    u8 romByte(u32 offset) {
+        return static_cast<u8>((offset * 7) ^ (offset >> 8));
+    }
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 60;
+
+    FILE* file = fopen(s_bios_path, "wb");
+
+    if (file == nullptr) {
+        perror(s_bios_path);
+        return 1;
+    }
+    fwrite(s_bios, sizeof(s_bios), 1, file);
+    fclose(file);
+
+    static u32 framebuffer[240 * 160];
+
+    Config config;
+    config.framebuffer = framebuffer;
+    config.bios_path   = s_bios_path;
+
+    Emulator emulator(&config);
+    emulator.reloadConfig();
+
+    auto cart = std::make_shared<Cartridge>();
+    cart->size   = 0x100000;
+    cart->data   = new u8[cart->size];
+    cart->backup = nullptr;
+    cart->type   = SAVE_SRAM;
+
+    for (u32 i = 0; i < cart->size; i++) {
+        cart->data[i] = romByte(i);
+    }
+    emulator.loadGame(cart);
+    remove(s_bios_path);
+
+    auto& apu   = emulator.getAPU();
+    auto& stats = apu.getStats();
+
+    // The first overflow finds the FIFO empty, DMA1 only refills it from then on.
+    const u32 underruns = 1;
+
+    u32 checked = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        while (emulator.runFor(64) != Emulator::RunResult::FrameEnded) {
+            u32 pulled = stats.fifo_samples[0];
+
+            if (pulled <= underruns) {
+                continue;
+            }
+
+            // look at the next byte without taking it out of the real FIFO
+            auto fifo = apu.getIO().fifo[0];
+            u8   head = static_cast<u8>(fifo.dequeue());
+            u32  next = pulled - underruns;
+
+            if (head != romByte(next)) {
+                fprintf(stderr, "frame %d: byte %u is %02x, expected %02x\n", frame, next, head, romByte(next));
+                return 1;
+            }
+            checked = next;
+        }
+    }
+
+    if (checked == 0) {
+        fprintf(stderr, "no FIFO samples were played\n");
+        return 1;
+    }
+    printf("%u FIFO A bytes in ROM order\n", checked);
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Micro-benchmark for Util::Scaler, runs on a Linux host.
+//
+//   g++ -O2 -std=gnu++17 -Isrc/nanoboyadvance -o scaler_bench bench/scaler_bench.cpp src/nanoboyadvance/util/scaler.cpp
+//   ./scaler_bench [frames]
+//
+// Lives outside of src/ so the PROS build does not pick it up.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "util/scaler.hpp"
+
+using Util::Scaler;
+
+namespace {
+    // the per-pixel fixed-point mapping the frontend used before
+    void scaleReference(const u32* src, u32* dst, int dst_width, int dst_height) {
+        int x_ratio = (240 << 16) / dst_width  + 1;
+        int y_ratio = (160 << 16) / dst_height + 1;
+
+        for (int i = 0; i < dst_height; i++) {
+            for (int j = 0; j < dst_width; j++) {
+                dst[i * dst_width + j] = src[((i * y_ratio) >> 16) * 240 + ((j * x_ratio) >> 16)];
+            }
+        }
+    }
+
+    template <typename F>
+    double measure(int frames, F&& f) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < frames; i++) {
+            f();
+        }
+
+        std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+
+        return time.count() / frames;
+    }
+}
+
+int main(int argc, char** argv) {
+    int frames = (argc > 1) ? std::atoi(argv[1]) : 2000;
+
+    struct Case {
+        const char* name;
+        int width;
+        int height;
+        Scaler::Mode mode;
+    } cases[] = {
+        { "480x240 stretch",   480, 240, Scaler::Mode::Stretch },
+        { "480x240 aspect",    480, 240, Scaler::Mode::Aspect  },
+        { "480x240 integer",   480, 240, Scaler::Mode::Integer },
+        { "480x320 integer 2x", 480, 320, Scaler::Mode::Integer },
+        { "800x600 aspect",    800, 600, Scaler::Mode::Aspect  }
+    };
+
+    std::vector<u32> src(240 * 160);
+
+    for (auto& pixel : src) {
+        pixel = std::rand();
+    }
+
+    for (auto& c : cases) {
+        std::vector<u32> dst(c.width * c.height);
+        Scaler scaler;
+
+        scaler.configure(240, 160, c.width, c.height, c.mode);
+
+        double ours = measure(frames, [&] {
+            scaler.scaleFrame(src.data(), dst.data(), c.width);
+        });
+        double reference = measure(frames, [&] {
+            scaleReference(src.data(), dst.data(), c.width, c.height);
+        });
+
+        std::printf("%-20s %3dx%-3d at (%3d,%3d): %8.2f us/frame (per-pixel: %8.2f us/frame)\n",
+            c.name, scaler.width(), scaler.height(), scaler.x(), scaler.y(), ours, reference);
+    }
+
+    return 0;
+}
@@ -17,426 +17,487 @@
   * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
   */
 
-#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include "apu.hpp"
 
 #include "util/logger.hpp"
 
 namespace Core {
-    #ifndef M_PI
-    #define M_PI (3.14159265358979323846)
-    #endif
-
-    constexpr float APU::s_wave_duty[4];
-    constexpr int   APU::s_sweep_clock[8];
-    constexpr int   APU::s_envelope_clock[8];
-    constexpr float APU::s_psg_volume[4];
-    constexpr float APU::s_dma_volume[2];
-    constexpr float APU::s_wav_volume[4];
-
-    APU::APU(Config* config) : m_config(config) {
+    constexpr int APU::s_wave_duty[4];
+    constexpr int APU::s_noise_divisor[8];
+    constexpr int APU::s_psg_shift[4];
+    constexpr int APU::s_dma_volume[2];
+    constexpr int APU::s_wav_volume[4];
+
+    APU::APU(Config* config) : m_psg_buffer { Util::BlipBuffer(s_buffer_size), Util::BlipBuffer(s_buffer_size) },
+                               m_config(config) {
         // forward FIFO access to SOUNDCNT register (for FIFO resetting)
         regs.control.fifo[0] = &regs.fifo[0];
         regs.control.fifo[1] = &regs.fifo[1];
 
         // reset state
+        reloadConfig();
         reset();
     }
 
     void APU::reset() {
-        /*
         // reset ringbuffer(s)
-        read_pos  = 0;
-        write_pos = 0;
-        memset(ringbuffers[0], 0, 0x4000);
-        memset(ringbuffers[1], 0, 0x4000);
+        memset(ringbuffers, 0, sizeof(ringbuffers));
+        clearOutput();
 
         // reset channel (registers)
         for (int i = 0; i < 2; i++) {
             regs.fifo[i].reset();
             regs.tone[i].reset();
+            fifo_sample[i] = 0;
         }
         regs.wave.reset();
         regs.noise.reset();
+        memset(regs.wave_ram, 0, sizeof(regs.wave_ram));
 
         // reset control registers
         regs.bias.reset();
         regs.control.reset();
-        */
+
+        m_time           = 0;
+        m_sequencer_left = s_sequencer_period;
+        m_sequencer_step = 0;
+
+        m_stats = { 0, 0, { 0, 0, 0, 0 }, 0, { 0, 0 } };
     }
 
     void APU::reloadConfig() {
-        //sample_rate = m_config->audio.sample_rate;
+        if (m_config->audio.sample_rate > 0) {
+            sample_rate = m_config->audio.sample_rate;
+        }
+
+        m_min_period = 2 * s_cycles_per_second / sample_rate;
+
+        m_psg_buffer[0].setRates(s_cycles_per_second, sample_rate);
+        m_psg_buffer[1].setRates(s_cycles_per_second, sample_rate);
+
+        // buffered samples were made for the old sample rate
+        clearOutput();
     }
 
-    auto APU::convertFrequency(int freq) -> float {
-        //return 131072 / (2048 - freq);
-        return 0;
+    void APU::clearOutput() {
+        read_pos  = 0;
+        write_pos = 0;
+
+        for (int side = 0; side < 2; side++) {
+            m_psg_buffer[side].clear();
+            m_psg_gain [side] = 0;
+            m_psg_level[side] = 0;
+        }
+        for (int i = 0; i < 4; i++) {
+            m_psg_output[i] = 0;
+        }
     }
 
-    auto APU::generateQuad(int id) -> float {
-        /*
-        auto& channel  = regs.tone[id];
-        auto& internal = channel.internal;
-        auto& cycles   = internal.cycles;
+    void APU::clockSequencer() {
+        switch (m_sequencer_step) {
+            case 0: case 4:
+                clockLength();
+                break;
+            case 2: case 6:
+                clockLength();
+                clockSweep();
+                break;
+            case 7:
+                clockEnvelope(regs.tone[0].envelope, regs.tone[0].internal.volume, regs.tone[0].internal.envelope_ticks);
+                clockEnvelope(regs.tone[1].envelope, regs.tone[1].internal.volume, regs.tone[1].internal.envelope_ticks);
+                clockEnvelope(regs.noise.envelope,   regs.noise.internal.volume,   regs.noise.internal.envelope_ticks);
+                break;
+        }
 
-        if (channel.apply_length) {
-            int max_cycles = (64 - channel.sound_length) * (16780000 / 256);
-            if (cycles.length >= max_cycles) {
-                return 0;
+        m_sequencer_step = (m_sequencer_step + 1) & 7;
+        m_stats.sequencer_ticks++;
+    }
+
+    void APU::clockLength() {
+        for (int i = 0; i < 2; i++) {
+            auto& internal = regs.tone[i].internal;
+
+            if (regs.tone[i].apply_length && internal.length != 0 && --internal.length == 0) {
+                internal.enabled = false;
             }
         }
 
-        float amplitude = (float)internal.volume * (1.0 / 16.0);
-        float frequency = convertFrequency(internal.frequency);
-        float position  = (float)((2 * M_PI * internal.sample * frequency) / sample_rate);
-        float wave_duty = s_wave_duty[channel.wave_duty];
+        if (regs.wave.apply_length && regs.wave.internal.length != 0 && --regs.wave.internal.length == 0) {
+            regs.wave.internal.enabled = false;
+        }
 
-        float value = 0;
+        if (regs.noise.apply_length && regs.noise.internal.length != 0 && --regs.noise.internal.length == 0) {
+            regs.noise.internal.enabled = false;
+        }
+    }
 
-        // generates sample based upon wave duty and sample position
-        if (std::fmod(position, 2 * M_PI) <= 2 * M_PI * wave_duty) {
-            value = 127;
-        } else {
-            value = -128;
+    void APU::clockSweep() {
+        // only SOUND1 has a sweep unit
+        auto& sweep    = regs.tone[0].sweep;
+        auto& internal = regs.tone[0].internal;
+
+        if (sweep.time == 0 || --internal.sweep_ticks > 0) {
+            return;
         }
 
-        if (++internal.sample >= sample_rate) {
-            internal.sample = 0;
+        internal.sweep_ticks = sweep.time;
+
+        if (sweep.shift == 0) {
+            return;
         }
 
-        return amplitude * value;
-        */
-        return 0;
+        int delta = internal.frequency >> sweep.shift;
+
+        if (sweep.direction == SWEEP_DEC) {
+            internal.frequency -= delta;
+        } else if (internal.frequency + delta > 2047) {
+            internal.enabled = false;
+        } else {
+            internal.frequency += delta;
+        }
     }
 
-    auto APU::generateWave() -> float {
-        /*
-        auto& wave     = regs.wave;
-        auto& wave_int = wave.internal;
+    void APU::clockEnvelope(const IO::VolumeEnvelope& envelope, int& volume, int& ticks) {
+        if (envelope.time == 0 || --ticks > 0) {
+            return;
+        }
 
-        if (!wave.playback) {
-            return 0;
+        ticks = envelope.time;
+
+        if (envelope.direction == ENV_INC) {
+            if (volume != 15) volume++;
+        } else {
+            if (volume != 0 ) volume--;
         }
+    }
 
-        if (wave.apply_length) {
-            int max_cycles = (256 - wave.sound_length) * (16780000 / 256);
+    void APU::runQuad(int id, int cycles) {
+        auto& channel  = regs.tone[id];
+        auto& internal = channel.internal;
 
-            if (wave_int.length_cycles >= max_cycles) {
-                return 0;
-            }
+        // a period is eight duty steps of (2048 - frequency) * 16 cycles
+        int period = (2048 - internal.frequency) * 16;
+
+        if (!internal.enabled || period * 8 < m_min_period) {
+            internal.edge_cycles = 0;
+            return;
         }
 
-        u8  byte   = regs.wave_ram[wave.bank_number][wave_int.sample_ptr >> 1];
-        int sample = (wave_int.sample_ptr & 1) ? (byte & 15) : (byte >> 4);
+        int duty = s_wave_duty[channel.wave_duty];
+        int time = internal.edge_cycles;
 
-        float volume = wave.force_volume ? 0.75 : s_wav_volume[wave.volume];
+        while (time < cycles) {
+            internal.high = !internal.high;
+            setOutput(id, m_time + time, getQuadOutput(id) << s_psg_fraction_bits);
+            time += (internal.high ? duty : 8 - duty) * period;
+        }
 
-        return (sample - 8) * volume * 8;
-        */
-        return 0;
+        internal.edge_cycles = time - cycles;
     }
 
-    auto APU::generateNoise() -> float {
-        /*
-        auto& noise     = regs.noise;
-        auto& noise_int = noise.internal;
+    void APU::runWave(int cycles) {
+        auto& wave     = regs.wave;
+        auto& wave_int = wave.internal;
 
-        if (noise.apply_length) {
-            int max_cycles = (64 - noise.sound_length) * (16780000 / 256);
+        // each sample lasts (2048 - frequency) * 8 cycles
+        int period = (2048 - wave.frequency) * 8;
 
-            if (noise_int.length_cycles >= max_cycles) {
-                return 0;
-            }
+        if (!wave_int.enabled || period * 32 < m_min_period) {
+            return;
         }
 
-        float amplitude = (float)noise_int.volume * (1.0 / 16.0);
+        int mask = wave.dimension ? 63 : 31;
+        int time = wave_int.step_cycles;
+
+        while (time < cycles) {
+            wave_int.position = (wave_int.position + 1) & mask;
+            setOutput(2, m_time + time, getWaveOutput() << s_psg_fraction_bits);
+            time += period;
+        }
 
-        return amplitude * (noise_int.output ? 128 : -128);
-        */
-        return 0;
+        wave_int.step_cycles = time - cycles;
     }
 
-    void APU::updateQuad(int step_cycles) {
-        /*
-        for (int i = 0; i < 2; i++) {
-            auto& channel  = regs.tone[i];
-            auto& internal = channel.internal;
-            auto& cycles   = internal.cycles;
-            auto& sweep    = channel.sweep;
-            auto& envelope = channel.envelope;
+    void APU::runNoise(int cycles) {
+        auto& noise     = regs.noise;
+        auto& noise_int = noise.internal;
 
-            if (sweep.time != 0) {
-                int sweep_clock = s_sweep_clock[sweep.time];
+        static const u16 lfsr_xor[] = { 0x6000, 0x0060 };
 
-                cycles.sweep += step_cycles;
+        if (!noise_int.enabled) {
+            return;
+        }
 
-                // not very optimized - i suppose
-                while (cycles.sweep >= sweep_clock) {
-                    int shift = internal.frequency >> sweep.shift;
+        int period = getNoisePeriod();
+        int time   = noise_int.shift_cycles;
 
-                    if (sweep.direction == SWEEP_INC) {
-                        internal.frequency += shift;
-                    } else {
-                        internal.frequency -= shift;
-                    }
+        auto shift = [&]() {
+            int carry = noise_int.lfsr & 1;
 
-                    if (internal.frequency >= 2048) {
-                        internal.frequency = 2047;
-                    } else if (internal.frequency < 0) {
-                        internal.frequency = 0;
-                    }
+            noise_int.lfsr >>= 1;
 
-                    cycles.sweep -= sweep_clock;
-                }
+            if (carry) {
+                noise_int.lfsr ^= lfsr_xor[noise.size_flag];
+            }
+            noise_int.output = carry;
+            m_stats.noise_shifts++;
+        };
+
+        int shifts = getNoiseShiftsPerSample();
+
+        if (shifts == 1) {
+            while (time < cycles) {
+                shift();
+                setOutput(3, m_time + time, getNoiseOutput() << s_psg_fraction_bits);
+                time += period;
             }
+        } else {
+            // Faster than the sample rate the LFSR still shifts as often, but only
+            // the average amplitude of each sample's shifts is added as one delta.
+            while (time < cycles) {
+                int start = time;
+                int sum   = 0;
+                int count = 0;
+
+                do {
+                    shift();
+                    sum  += getNoiseOutput();
+                    time += period;
+                    count++;
+                } while (time < cycles && count < shifts);
+
+                setOutput(3, m_time + start, (sum << s_psg_fraction_bits) / count);
+            }
+        }
 
-            if (envelope.time != 0) {
-                int envelope_clock = s_envelope_clock[envelope.time];
+        noise_int.shift_cycles = time - cycles;
+    }
 
-                cycles.envelope += step_cycles;
+    auto APU::getNoisePeriod() -> int {
+        auto& noise = regs.noise;
 
-                // not very optimized - i suppose
-                while (cycles.envelope >= envelope_clock) {
+        // 524288 Hz / r / 2^(s+1) in cycles
+        return s_noise_divisor[noise.divide_ratio] << (noise.frequency + 1);
+    }
 
-                    if (envelope.direction == ENV_INC) {
-                        if (internal.volume != 15) internal.volume++;
-                    } else {
-                        if (internal.volume != 0 ) internal.volume--;
-                    }
+    auto APU::getNoiseShiftsPerSample() -> int {
+        int period = getNoisePeriod();
 
-                    cycles.envelope -= envelope_clock;
-                }
-            }
+        return ((m_min_period >> 1) + period - 1) / period;
+    }
 
-            if (channel.apply_length) {
-                cycles.length += step_cycles;
-            }
+    auto APU::getQuadOutput(int id) -> int {
+        auto& internal = regs.tone[id].internal;
+
+        if (!internal.enabled || m_config->audio.mute.psg[id] || (2048 - internal.frequency) * 128 < m_min_period) {
+            return 0;
         }
-        */
+        return internal.high ? internal.volume : -internal.volume;
     }
 
-    void APU::updateWave(int step_cycles) {
-        /*
+    auto APU::getWaveOutput() -> int {
         auto& wave     = regs.wave;
         auto& wave_int = wave.internal;
 
-        // concert sample rate to cycles
-        int required = 16780000 / (2097152 / (2048 - wave.frequency));
-
-        wave_int.sample_cycles += step_cycles;
+        if (!wave_int.enabled || m_config->audio.mute.psg[2] || (2048 - wave.frequency) * 256 < m_min_period) {
+            return 0;
+        }
 
-        if (wave_int.sample_cycles >= required) {
-            int amount = wave_int.sample_cycles / required;
+        // 64-digit mode plays the selected bank, then the other one
+        int position = wave_int.position;
+        int bank     = wave.bank_number ^ (position >> 5);
 
-            wave_int.sample_ptr += amount;
+        u8  byte   = regs.wave_ram[bank][(position & 31) >> 1];
+        int sample = (position & 1) ? (byte & 15) : (byte >> 4);
 
-            // check for wave RAM overflow
-            if (wave_int.sample_ptr >= 32) {
-                // wraparound sample pointer
-                wave_int.sample_ptr &= 0x1F;
+        int volume = wave.force_volume ? 3 : s_wav_volume[wave.volume];
 
-                // 64-digit mode?
-                if (wave.dimension) {
-                    // toggle bank number
-                    wave.bank_number ^= 1;
-                }
-            }
+        return ((sample * 2 - 15) * volume) >> 2;
+    }
 
-            // eat the cycles that were "consumed"
-            wave_int.sample_cycles -= amount * required;
-        }
+    auto APU::getNoiseOutput() -> int {
+        auto& noise_int = regs.noise.internal;
 
-        if (wave.apply_length) {
-            wave_int.length_cycles += step_cycles;
+        if (!noise_int.enabled || m_config->audio.mute.psg[3]) {
+            return 0;
         }
-        */
+        return noise_int.output ? noise_int.volume : -noise_int.volume;
     }
 
-    void APU::updateNoise(int step_cycles) {
-        /*
-        auto& noise     = regs.noise;
-        auto& noise_int = noise.internal;
-        auto& envelope  = noise.envelope;
+    void APU::setOutput(int channel, u32 time, int value) {
+        int delta = value - m_psg_output[channel];
 
-        const u16 lfsr_xor[] = { 0x6000, 0x0060 };
+        if (delta == 0) {
+            return;
+        }
 
-        // TODO: make this less shitty
-        int shift_freq = 524288;
+        m_psg_output[channel] = value;
+        m_stats.channel_edges[channel]++;
 
-        if (noise.divide_ratio == 0) {
-            shift_freq <<= 1;
-        } else {
-            shift_freq /= noise.divide_ratio;
+        for (int side = 0; side < 2; side++) {
+            if (regs.control.psg.enable[side][channel]) {
+                int side_delta = delta * m_psg_gain[side];
+
+                m_psg_buffer[side].addDelta(time, side_delta);
+                m_psg_level[side] += side_delta;
+            }
         }
+    }
 
-        shift_freq >>= (noise.frequency + 1);
+    void APU::syncOutput() {
+        auto& psg = regs.control.psg;
 
-        int needed_cycles = 16780000 / shift_freq;
+        m_psg_output[0] = getQuadOutput(0) << s_psg_fraction_bits;
+        m_psg_output[1] = getQuadOutput(1) << s_psg_fraction_bits;
+        m_psg_output[2] = getWaveOutput() << s_psg_fraction_bits;
 
-        noise_int.shift_cycles += step_cycles;
+        // averaged noise catches up with its next sample instead
+        if (!regs.noise.internal.enabled || getNoiseShiftsPerSample() == 1) {
+            m_psg_output[3] = getNoiseOutput() << s_psg_fraction_bits;
+        }
 
-        while (noise_int.shift_cycles >= needed_cycles) {
-            int carry = noise_int.lfsr & 1;
+        for (int side = 0; side < 2; side++) {
+            // master volume (1/8 to 8/8) and 25/50/100%, in quarters
+            if (regs.control.master_enable && !m_config->audio.mute.master) {
+                m_psg_gain[side] = (psg.master[side] + 1) << (2 - s_psg_shift[psg.volume]);
+            } else {
+                m_psg_gain[side] = 0;
+            }
 
-            noise_int.lfsr >>= 1;
+            int level = 0;
 
-            if (carry) {
-                noise_int.lfsr ^= lfsr_xor[noise.size_flag];
+            for (int i = 0; i < 4; i++) {
+                if (psg.enable[side][i]) level += m_psg_output[i];
+            }
+            level *= m_psg_gain[side];
+
+            if (level != m_psg_level[side]) {
+                m_psg_buffer[side].addDelta(m_time, level - m_psg_level[side]);
+                m_psg_level[side] = level;
             }
-            noise_int.output        = carry;
-            noise_int.shift_cycles -= needed_cycles;
         }
+    }
+
+    void APU::mixChannels(u16* stream, int samples) {
+        auto& bias = regs.bias;
+
+        int psg[2][256];
+
+        while (samples > 0) {
+            int count = std::min(samples, 256);
 
-        if (envelope.time != 0) {
-            int envelope_clock = s_envelope_clock[envelope.time];
+            m_psg_buffer[SIDE_LEFT ].readSamples(psg[SIDE_LEFT ], count);
+            m_psg_buffer[SIDE_RIGHT].readSamples(psg[SIDE_RIGHT], count);
 
-            noise_int.envelope_cycles += step_cycles;
+            for (int i = 0; i < count; i++) {
+                for (int side = 0; side < 2; side++) {
+                    int output = (psg[side][i] >> (2 + s_psg_fraction_bits)) + ringbuffers[side][read_pos];
 
-            // TODO:
-            // 1) not very optimized - i suppose
-            // 2) almost the same as QUAD envelope code
-            while (noise_int.envelope_cycles >= envelope_clock) {
-                if (envelope.direction == ENV_INC) {
-                    if (noise_int.volume != 15) noise_int.volume++;
-                } else {
-                    if (noise_int.volume != 0 ) noise_int.volume--;
+                    // makeup gain (BIAS) and clipping emulation
+                    output += bias.level;
+                    if (output < 0)     output = 0;
+                    if (output > 0x3FF) output = 0x3FF;
+
+                    // reduce amplitude resolution
+                    output = (output >> bias.resolution) << bias.resolution;
+
+                    stream[i * 2 + side] = output << 6;
                 }
 
-                noise_int.envelope_cycles -= envelope_clock;
+                // update read position
+                read_pos = (read_pos + 1) & (s_buffer_size - 1);
             }
-        }
 
-        if (noise.apply_length) {
-            noise_int.length_cycles += step_cycles;
+            stream  += count * 2;
+            samples -= count;
         }
-        */
     }
 
-    void APU::mixChannels(int samples) {
-        /*
-		// If audio is completely muted we just write a bunch of 0's to the stereo ringbuffer.
-		if (m_config->audio.mute.master) {
-			for (int i = 0; i < samples; i++) {
-				ringbuffers[SIDE_LEFT ][write_pos] = 0;
-				ringbuffers[SIDE_RIGHT][write_pos] = 0;
-
-				// update write position
-				write_pos = (write_pos + 1) & 0x3FFF;
-			}				
-			return;
-		}
-
-        auto& psg  = regs.control.psg;
+    void APU::step(int step_cycles) {
+        auto& mute = m_config->audio.mute;
         auto& dma  = regs.control.dma;
-        auto& bias = regs.bias;
 
-        float psg_volume = s_psg_volume[psg.volume];
+        m_time = 0;
 
-        const float fifo_volume[2] = {
-            APU::s_dma_volume[dma[0].volume],
-            APU::s_dma_volume[dma[1].volume]
-        };
+        while (step_cycles > 0) {
+            int cycles = std::min(step_cycles, m_sequencer_left);
 
-        for (int sample = 0; sample < samples; sample++) {
-            s16 output[2] { 0, 0 };
-
-            float volume_left  = (float)psg.master[SIDE_LEFT ] / 7.0;
-            float volume_right = (float)psg.master[SIDE_RIGHT] / 7.0;
-
-            // generate PSG channels
-            s16 tone1 = m_config->audio.mute.psg[0] ? 0 : (s16)generateQuad(0);
-            s16 tone2 = m_config->audio.mute.psg[1] ? 0 : (s16)generateQuad(1);
-            s16 wave  = m_config->audio.mute.psg[2] ? 0 : (s16)generateWave();
-            s16 noise = m_config->audio.mute.psg[3] ? 0 : (s16)generateNoise();
-
-            // mix PSGs on the left channel
-            if (psg.enable[SIDE_LEFT][0]) output[SIDE_LEFT] += tone1;
-            if (psg.enable[SIDE_LEFT][1]) output[SIDE_LEFT] += tone2;
-            if (psg.enable[SIDE_LEFT][2]) output[SIDE_LEFT] += wave;
-            if (psg.enable[SIDE_LEFT][3]) output[SIDE_LEFT] += noise;
-
-            // mix PSGs on the right channel
-            if (psg.enable[SIDE_RIGHT][0]) output[SIDE_RIGHT] += tone1;
-            if (psg.enable[SIDE_RIGHT][1]) output[SIDE_RIGHT] += tone2;
-            if (psg.enable[SIDE_RIGHT][2]) output[SIDE_RIGHT] += wave;
-            if (psg.enable[SIDE_RIGHT][3]) output[SIDE_RIGHT] += noise;
-
-            // apply master volume to the PSG channels
-            output[SIDE_LEFT ] *= psg_volume * volume_left;
-            output[SIDE_RIGHT] *= psg_volume * volume_right;
-
-            // add FIFO audio samples
-            for (int fifo = 0; fifo < 2; fifo++) {
-            	// Skip FIFO if is muted.
-            	if (m_config->audio.mute.dma[fifo]) continue;
-            	
-                if (dma[fifo].enable[SIDE_LEFT]) {
-                    output[SIDE_LEFT ] += fifo_sample[fifo] * fifo_volume[fifo];
-                }
-                if (dma[fifo].enable[SIDE_RIGHT]) {
-                    output[SIDE_RIGHT] += fifo_sample[fifo] * fifo_volume[fifo];
-                }
+            syncOutput();
+
+            runQuad(0, cycles);
+            runQuad(1, cycles);
+            runWave(cycles);
+            runNoise(cycles);
+
+            m_time           += cycles;
+            step_cycles      -= cycles;
+            m_sequencer_left -= cycles;
+
+            if (m_sequencer_left == 0) {
+                clockSequencer();
+                m_sequencer_left = s_sequencer_period;
             }
+        }
 
-            // makeup gain (BIAS) and clipping emulation
-            output[SIDE_LEFT ] += bias.level;
-            output[SIDE_RIGHT] += bias.level;
-            if (output[SIDE_LEFT ] < 0)     output[SIDE_LEFT ] = 0;
-            if (output[SIDE_RIGHT] < 0)     output[SIDE_RIGHT] = 0;
-            if (output[SIDE_LEFT ] > 0x3FF) output[SIDE_LEFT ] = 0x3FF;
-            if (output[SIDE_RIGHT] > 0x3FF) output[SIDE_RIGHT] = 0x3FF;
+        int available = m_psg_buffer[0].samplesAvailable();
 
-            // reduce amplitude resolution
-            output[SIDE_LEFT ] = (output[SIDE_LEFT ] >> bias.resolution) << bias.resolution;
-            output[SIDE_RIGHT] = (output[SIDE_RIGHT] >> bias.resolution) << bias.resolution;
+        m_psg_buffer[0].endFrame(m_time);
+        m_psg_buffer[1].endFrame(m_time);
 
-            // copy audio into the output ringbuffers
-            ringbuffers[SIDE_LEFT ][write_pos] = output[SIDE_LEFT ] * 64;
-            ringbuffers[SIDE_RIGHT][write_pos] = output[SIDE_RIGHT] * 64;
+        // FIFO output for the new samples
+        int fifo_output[2] = { 0, 0 };
 
-            // update write position
-            write_pos = (write_pos + 1) & 0x3FFF;
+        if (regs.control.master_enable && !mute.master) {
+            for (int side = 0; side < 2; side++) {
+                for (int fifo = 0; fifo < 2; fifo++) {
+                    if (dma[fifo].enable[side] && !mute.dma[fifo]) {
+                        fifo_output[side] += fifo_sample[fifo] * s_dma_volume[dma[fifo].volume];
+                    }
+                }
+            }
         }
-        */
-    }
 
-    void APU::step(int step_cycles) {
-        /*
-        int cycles_per_sample = 16780000 / sample_rate;
+        int samples = m_psg_buffer[0].samplesAvailable() - available;
 
-        updateQuad(step_cycles);
-        updateWave(step_cycles);
-        updateNoise(step_cycles);
+        for (int i = 0; i < samples; i++) {
+            ringbuffers[SIDE_LEFT ][write_pos] = fifo_output[SIDE_LEFT ];
+            ringbuffers[SIDE_RIGHT][write_pos] = fifo_output[SIDE_RIGHT];
 
-        cycles_elapsed += step_cycles;
+            // update write position
+            write_pos = (write_pos + 1) & (s_buffer_size - 1);
+        }
 
-        if (cycles_elapsed >= cycles_per_sample) {
-            int samples = cycles_elapsed / cycles_per_sample;
+        m_stats.samples += samples;
 
-            mixChannels(samples);
+        // without anyone reading, keep the latest half of the buffer
+        if (m_psg_buffer[0].samplesAvailable() > s_buffer_size - 256) {
+            int drop = m_psg_buffer[0].samplesAvailable() - s_buffer_size / 2;
 
-            // consume the cycles required for each sample
-            cycles_elapsed -= samples * cycles_per_sample;
+            m_psg_buffer[0].removeSamples(drop);
+            m_psg_buffer[1].removeSamples(drop);
+            read_pos = (read_pos + drop) & (s_buffer_size - 1);
         }
-        */
     }
 
     void APU::fillBuffer(u16* stream, int length) {
-        /*
         // divide length by four because:
         // 1) length is provided in bytes, while we work with hwords
         // 2) length is twice the actual length because of two stereo channels
         length >>= 2;
 
-        for (int i = 0; i < length; i++) {
-            // copy left/right sample from ringbuffer to SDL buffer
-            stream[i * 2 + 0] = ringbuffers[SIDE_LEFT ][read_pos];
-            stream[i * 2 + 1] = ringbuffers[SIDE_RIGHT][read_pos];
+        int samples = std::min(length, m_psg_buffer[0].samplesAvailable());
 
-            // update read position
-            read_pos = (read_pos + 1) & 0x3FFF;
+        mixChannels(stream, samples);
+
+        // on underrun the output rests at the bias level
+        u16 silence = std::min(std::max(regs.bias.level, 0), 0x3FF) << 6;
+
+        for (int i = samples; i < length; i++) {
+            stream[i * 2 + 0] = silence;
+            stream[i * 2 + 1] = silence;
         }
-        */
     }
+
 }
@@ -21,6 +21,7 @@
 
 #include "fifo.hpp"
 #include "util/integer.hpp"
+#include "util/blipbuffer.hpp"
 #include "../config.hpp"
 
 namespace Core {
@@ -30,33 +31,99 @@ namespace Core {
         // APU IO interface
         #include "io.inl"
 
-        static constexpr float s_wave_duty[4] = { 0.125, 0.25, 0.5, 0.75 };
-        
-        static constexpr int s_sweep_clock[8] = {
-            0, 130884, 261768, 392652, 523536, 654420, 785304, 916188
-        };
-        
-        static constexpr int s_envelope_clock[8] = {
-            0, 262187, 524375, 786562, 1048750, 1310937, 1573125, 1835312
-        };
-        
-        static constexpr float s_psg_volume[] = { 0.25, 0.5, 1, 1 };
-        static constexpr float s_dma_volume[] = { 2, 4 };
-        static constexpr float s_wav_volume[] = { 0, 1, 0.5, 0.25 };
+        static constexpr int s_cycles_per_second = 16777216;
+
+        // The frame sequencer clocks length counters at 256 Hz, the sweep
+        // at 128 Hz and envelopes at 64 Hz.
+        static constexpr int s_sequencer_period = s_cycles_per_second / 512;
+
+        // high part of a square wave, in eighths of the period
+        static constexpr int s_wave_duty[4] = { 1, 2, 4, 6 };
+
+        // noise shift period in cycles for each divide ratio (r=0 counts as 0.5)
+        static constexpr int s_noise_divisor[8] = { 16, 32, 64, 96, 128, 160, 192, 224 };
+
+        static constexpr int s_psg_shift [4] = { 2, 1, 0, 0 }; // 25%, 50%, 100%, forbidden
+        static constexpr int s_dma_volume[2] = { 2, 4 };       // 50%, 100%
+        static constexpr int s_wav_volume[4] = { 0, 4, 2, 1 }; // in quarters
+
+        // fractional bits of the channel amplitudes fed into the PSG buffers
+        static constexpr int s_psg_fraction_bits = 3;
+
+        // samples buffered for fillBuffer, older ones are dropped
+        static constexpr int s_buffer_size = 0x1000;
 
         // Stores latched FIFO samples
         s8 fifo_sample[2];
 
-        // Stereo output (ring buffers)
-        u16 ringbuffers[2][0x4000];
+        // FIFO output of each sample in the PSG buffers (ring buffers)
+        s16 ringbuffers[2][s_buffer_size];
         int read_pos  = 0;
         int write_pos = 0;
 
-        int sample_rate    = 44100;
-        int cycles_elapsed = 0;
+        int sample_rate = 44100;
+
+        // PSG output of each side, in quarters of the 10-bit output and with
+        // s_psg_fraction_bits more precision. Channels add a delta at every edge
+        // of their waveform, noise above the sample rate once per sample.
+        Util::BlipBuffer m_psg_buffer[2];
+        int m_psg_output[4];   // current amplitude of each channel, with fraction bits
+        int m_psg_gain[2];     // SOUNDCNT_L/H volume of each side
+        int m_psg_level[2];    // sum of the deltas added to each side
+
+        // waves shorter than two samples are above the Nyquist frequency and left out
+        int m_min_period;
+
+        u32 m_time;            // cycles since the start of the step
+        int m_sequencer_left;  // cycles until the next sequencer step
+        int m_sequencer_step;  // 0-7
 
         Config* m_config;
 
+    public:
+        // What each channel costs: the edges of each PSG waveform, the LFSR shifts
+        // of the noise channel and the samples read from each FIFO.
+        struct Stats {
+            u32 samples;            // stereo samples generated
+            u32 sequencer_ticks;
+            u32 channel_edges[4];
+            u32 noise_shifts;
+            u32 fifo_samples[2];
+        };
+
+    private:
+        Stats m_stats;
+
+        // Frame sequencer
+        void clockSequencer();
+        void clockLength();
+        void clockSweep();
+        static void clockEnvelope(const IO::VolumeEnvelope& envelope, int& volume, int& ticks);
+
+        // Sound Generators, add the edges within the next cycles
+        void runQuad(int id, int cycles);
+        void runWave (int cycles);
+        void runNoise(int cycles);
+
+        // LFSR shift period in cycles, and the shifts averaged into each output sample
+        auto getNoisePeriod() -> int;
+        auto getNoiseShiftsPerSample() -> int;
+
+        // current amplitude of a channel (-15 to 15)
+        auto getQuadOutput(int id) -> int;
+        auto getWaveOutput()       -> int;
+        auto getNoiseOutput()      -> int;
+
+        // Adds the delta to a channel's new amplitude at a time within the step.
+        // The amplitude has s_psg_fraction_bits fraction bits.
+        void setOutput(int channel, u32 time, int value);
+
+        // Brings the PSG output up to date with volume, enable and envelope changes.
+        void syncOutput();
+
+        // Drops all buffered samples.
+        void clearOutput();
+
     public:
         APU(Config* config);
 
@@ -65,31 +132,21 @@ namespace Core {
 
         auto getIO() -> IO& { return regs; }
 
-        // Convert GBA frequency to real freq.
-        static auto convertFrequency(int freq) -> float;
-
-        // Sound Generators
-        auto generateQuad(int id) -> float;
-        auto generateWave()       -> float;
-        auto generateNoise()      -> float;
-
-        // Updates PSG states
-        void updateQuad (int step_cycles);
-        void updateWave (int step_cycles);
-        void updateNoise(int step_cycles);
+        auto getStats() const -> const Stats& { return m_stats; }
 
-        // Mix all channels together
-        void mixChannels(int samples);
+        // Mix PSG, FIFOs and bias into the output
+        void mixChannels(u16* stream, int samples);
 
         // Advance state by a given amount of cycles
         void step(int step_cycles);
 
-        // Fill audio buffer from ring buffer
+        // Fill audio buffer with the oldest buffered samples
         void fillBuffer(u16* stream, int length);
 
         // Pull next sample from FIFO A (0) or B (1)
         void signalFifoTransfer(int fifo_id) {
             fifo_sample[fifo_id] = regs.fifo[fifo_id].dequeue();
+            m_stats.fifo_samples[fifo_id]++;
         }
     };
 }
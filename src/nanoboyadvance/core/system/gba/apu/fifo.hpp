@@ -19,14 +19,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include "util/integer.hpp"
 
 namespace Core {
     class FIFO {
     private:
+        // ring buffer, the size must be a power of two
         static const int s_fifo_size = 32;
+        static const int s_fifo_mask = s_fifo_size - 1;
 
-        int index;
+        int read_pos;
+        int count;
         s8  buffer[s_fifo_size];
 
     public:
@@ -35,29 +39,36 @@ namespace Core {
         }
 
         void reset() {
-            index = 0;
+            read_pos = 0;
+            count    = 0;
         }
 
         bool requiresData() {
-            return index <= (s_fifo_size >> 1);
+            return count <= (s_fifo_size >> 1);
         }
 
         void enqueue(u8 data) {
-            if (index < s_fifo_size) {
-                buffer[index++] = static_cast<s8>(data);
+            if (count < s_fifo_size) {
+                buffer[(read_pos + count++) & s_fifo_mask] = static_cast<s8>(data);
+            }
+        }
+
+        // Enqueues a block of samples, e.g. the 16 bytes of a FIFO DMA.
+        void enqueue(const u8* data, int length) {
+            length = std::min(length, s_fifo_size - count);
+
+            for (int i = 0; i < length; i++) {
+                buffer[(read_pos + count++) & s_fifo_mask] = static_cast<s8>(data[i]);
             }
         }
 
         auto dequeue() -> s8 {
-            s8 value;
-            if (index == 0) {
+            if (count == 0) {
                 return 0;
             }
-            value = buffer[0];
-            for (int i = 1; i < index; i++) {
-                buffer[i - 1] = buffer[i];
-            }
-            index--;
+            s8 value = buffer[read_pos];
+            read_pos = (read_pos + 1) & s_fifo_mask;
+            count--;
             return value;
         }
     };
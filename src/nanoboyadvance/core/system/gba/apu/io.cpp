@@ -37,12 +37,14 @@ namespace Core {
         apply_length = false;
 
         // reset internal state
-        internal.sample    = 0;
-        internal.volume    = 0;
-        internal.frequency = 0;
-        internal.cycles.sweep    = 0;
-        internal.cycles.length   = 0;
-        internal.cycles.envelope = 0;
+        internal.enabled        = false;
+        internal.volume         = 0;
+        internal.frequency      = 0;
+        internal.length         = 0;
+        internal.sweep_ticks    = 0;
+        internal.envelope_ticks = 0;
+        internal.high           = false;
+        internal.edge_cycles    = 0;
     }
 
     auto APU::IO::ToneChannel::read(int offset) -> u8 {
@@ -89,36 +91,45 @@ namespace Core {
 
             // Duty/Len/Envelope
             case 2: {
-                sound_length = (value >> 0) & 63;
-                wave_duty    = (value >> 6) & 3;
+                sound_length    = (value >> 0) & 63;
+                wave_duty       = (value >> 6) & 3;
+                internal.length = 64 - sound_length;
                 break;
             }
             case 3: {
                 envelope.time      = (value >> 0) & 7;
                 envelope.direction = (value >> 3) & 1;
                 envelope.initial   = (value >> 4);
+
+                // zero volume without increase turns the channel off
+                if (envelope.initial == 0 && envelope.direction == ENV_DEC) {
+                    internal.enabled = false;
+                }
                 break;
             }
 
             // Frequency Control
             case 4: {
                 frequency = (frequency & ~0xFF) | value;
+                internal.frequency = frequency;
                 break;
             }
             case 5: {
                 frequency = (frequency &  0xFF) | ((value & 7) << 8);
                 apply_length = value & 0x40;
+                internal.frequency = frequency;
 
                 // on sound restart
                 if (value & 0x80) {
-                    // reload initial volume and frequency
-                    internal.volume    = envelope.initial;
-                    internal.frequency = frequency;
-
-                    // reset cycle counters
-                    internal.cycles.sweep    = 0;
-                    internal.cycles.length   = 0;
-                    internal.cycles.envelope = 0;
+                    if (internal.length == 0) {
+                        internal.length = 64;
+                    }
+
+                    // reload initial volume and restart the sequencer counters
+                    internal.enabled        = envelope.initial != 0 || envelope.direction == ENV_INC;
+                    internal.volume         = envelope.initial;
+                    internal.sweep_ticks    = sweep.time;
+                    internal.envelope_ticks = envelope.time;
                 }
                 break;
             }
@@ -136,9 +147,10 @@ namespace Core {
         bank_number  = 0;
         sound_length = 0;
 
-        internal.sample_ptr    = 0;
-        internal.sample_cycles = 0;
-        internal.length_cycles = 0;
+        internal.enabled        = false;
+        internal.length         = 0;
+        internal.position       = 0;
+        internal.step_cycles    = 0;
     }
 
     auto APU::IO::WaveChannel::read(int offset) -> u8 {
@@ -175,13 +187,18 @@ namespace Core {
                 dimension   = (value >> 5) & 1;
                 bank_number = (value >> 6) & 1;
                 playback    =  value & 0x80;
+
+                if (!playback) {
+                    internal.enabled = false;
+                }
                 break;
             }
             case 1: { break; }
 
             // Length/Volume
             case 2: {
-                sound_length = value;
+                sound_length    = value;
+                internal.length = 256 - sound_length;
                 break;
             }
             case 3: {
@@ -199,14 +216,14 @@ namespace Core {
                 frequency    = (frequency & 0xFF) | ((value & 7) << 8);
                 apply_length = value & 0x40;
 
-                // on sound restart
+                // on sound restart, in 64-digit mode output starts with the selected bank
                 if (value & 0x80) {
-                    internal.length_cycles = 0;
-
-                    // in 64-digit mode output starts with the first bank
-                    if (dimension) {
-                        bank_number = 0;
+                    if (internal.length == 0) {
+                        internal.length = 256;
                     }
+                    internal.enabled     = playback;
+                    internal.position    = 0;
+                    internal.step_cycles = (2048 - frequency) * 8;
                 }
                 break;
             }
@@ -226,12 +243,13 @@ namespace Core {
         size_flag   = false;
         apply_length = false;
 
-        internal.output          = 0;
-        internal.lfsr            = 0;
-        internal.volume          = 0;
-        internal.shift_cycles    = 0;
-        internal.length_cycles   = 0;
-        internal.envelope_cycles = 0;
+        internal.enabled        = false;
+        internal.output         = 0;
+        internal.lfsr           = 0;
+        internal.volume         = 0;
+        internal.length         = 0;
+        internal.envelope_ticks = 0;
+        internal.shift_cycles   = 0;
     }
 
     auto APU::IO::NoiseChannel::read(int offset) -> u8 {
@@ -265,13 +283,19 @@ namespace Core {
         switch (offset) {
             // Length/Envelope
             case 0: {
-                sound_length = value & 63;
+                sound_length    = value & 63;
+                internal.length = 64 - sound_length;
                 break;
             }
             case 1: {
                 envelope.time      = (value >> 0) & 7;
                 envelope.direction = (value >> 3) & 1;
                 envelope.initial   = (value >> 4);
+
+                // zero volume without increase turns the channel off
+                if (envelope.initial == 0 && envelope.direction == ENV_DEC) {
+                    internal.enabled = false;
+                }
                 break;
             }
 
@@ -289,12 +313,16 @@ namespace Core {
                 if (value & 0x80) {
                     const u16 lfsr_init[] = { 0x4000, 0x0040 };
 
-                    internal.output          = 0;
-                    internal.lfsr            = lfsr_init[size_flag];
-                    internal.volume          = envelope.initial;
-                    internal.shift_cycles    = 0;
-                    internal.length_cycles   = 0;
-                    internal.envelope_cycles = 0;
+                    if (internal.length == 0) {
+                        internal.length = 64;
+                    }
+
+                    internal.enabled        = envelope.initial != 0 || envelope.direction == ENV_INC;
+                    internal.output         = 0;
+                    internal.lfsr           = lfsr_init[size_flag];
+                    internal.volume         = envelope.initial;
+                    internal.envelope_ticks = envelope.time;
+                    internal.shift_cycles   = 0;
                 }
                 break;
             }
@@ -421,7 +449,7 @@ namespace Core {
                 break;
             }
             case 1: {
-                level      = (level & 0xFF) | (value << 8);
+                level      = (level & 0xFF) | ((value & 3) << 8);
                 resolution = value >> 6;
                 break;
             }
@@ -63,15 +63,15 @@ struct IO {
 
         // not visible to the CPU
         struct Internal {
-            int sample;
-            int volume;
-            int frequency;
-
-            struct Cycles {
-                int sweep;
-                int length;
-                int envelope;
-            } cycles;
+            bool enabled;
+            int  volume;
+            int  frequency;      // changed by the sweep
+            int  length;         // length counter, 256 Hz ticks left
+            int  sweep_ticks;    // 128 Hz ticks until the next sweep
+            int  envelope_ticks; // 64 Hz ticks until the next envelope step
+
+            bool high;           // part of the duty cycle that is playing
+            int  edge_cycles;    // cycles until the output flips
         } internal;
 
         void reset();
@@ -92,9 +92,11 @@ struct IO {
         int sound_length;
 
         struct Internal {
-            int sample_ptr;
-            int sample_cycles;
-            int length_cycles;
+            bool enabled;
+            int  length;
+
+            int  position;       // sample playing, 32-63 are in the other bank
+            int  step_cycles;    // cycles until the next sample
         } internal;
 
         void reset();
@@ -116,13 +118,14 @@ struct IO {
         bool apply_length;
 
         struct Internal {
-            u16 lfsr;
-            int output;
-
-            int volume;
-            int shift_cycles;
-            int length_cycles;
-            int envelope_cycles;
+            bool enabled;
+            u16  lfsr;
+            int  output;
+
+            int  volume;
+            int  length;
+            int  envelope_ticks;
+            int  shift_cycles;   // cycles until the next shift
         } internal;
 
         void reset();
@@ -21,8 +21,19 @@
 
 #include <string>
 #include "util/integer.hpp"
+#include "util/scaler.hpp"
+#include "util/triplebuffer.hpp"
 
 namespace Core {
+
+    // A complete picture handed from the PPU to the display (see Config::frames).
+    struct Frame {
+        u32 pixels[240 * 160];
+
+        // changes whenever the pixels of a line change, equal versions mean equal lines
+        u32 version[160];
+    };
+
     struct Config {
         /*enum GPIODeviceType {
             GPIO_NONE,
@@ -38,9 +49,68 @@ namespace Core {
         // Video output buffer
         u32* framebuffer = nullptr;
 
+        // Scaled video output, written by the PPU as each scanline finishes.
+        // Takes the place of `framebuffer` if `buffer` is set.
+        struct VideoOutput {
+            u32* buffer = nullptr; // top-left pixel of the output area
+            int  stride = 0;       // distance between two rows, in pixels
+            int  width  = 240;
+            int  height = 160;
+
+            // how the 240x160 picture is fit into width x height
+            Util::Scaler::Mode scale_mode = Util::Scaler::Mode::Stretch;
+        } video_output;
+
+        // Complete frames are published here for another thread to show, takes
+        // the place of `framebuffer` and `video_output` if set. The frames must
+        // start out zeroed.
+        Util::TripleBuffer<Frame>* frames = nullptr;
+
+        // Pre-render text BGs into bitmaps (up to 512 KB each) and copy scanlines
+        // out of them. Pays off for static or scrolling maps.
+        bool bg_layer_cache = false;
+
+        // Leave lines alone whose VRAM, OAM, palette and PPU register inputs did
+        // not change since they were last rendered. Requires an output buffer
+        // that keeps its contents between frames, `frames` carry them over.
+        bool skip_unchanged_lines = false;
+
+        // Only record the PPU registers during the visible lines and render the
+        // whole frame at VBlank, which keeps the renderer out of the CPU's caches.
+        // Mid-frame VRAM, palette and OAM writes are logged and replayed.
+        bool deferred_rendering = false;
+
+        // Render on a second thread while the CPU runs ahead, synchronized at VBlank.
+        // Only available where PPU_RENDER_THREAD is defined (not on the V5).
+        bool render_thread = false;
+
+        // Memory budget in bytes for decoded regular OBJs, used in 8KB slabs.
+        // Anything below one slab disables the cache.
+        u32 obj_cache_size = 0;
+
+        // Render only the even lines on one frame and the odd lines on the next,
+        // the other half keeps its pixels from the frame before. Requires an output
+        // buffer that keeps its contents between frames, `frames` carry them over.
+        bool interlace = false;
+
+        // Once rendering a frame took longer than this many microseconds, compose
+        // the rest of its lines without blending and windows. 0 disables the budget.
+        // The time is taken from the first rendered line of the frame, so without
+        // deferred rendering it includes the emulation in between.
+        u32 render_budget = 0;
+
+        // Microsecond clock for `render_budget`, any start value and resolution.
+        u32 (*clock_us)() = nullptr;
+
+        // 32-bit pixel format of both `framebuffer` and `video_output`
+        enum class PixelFormat {
+            ARGB8888, // 0xFFRRGGBB
+            XRGB8888  // 0x00RRGGBB, e.g. LVGL with LV_COLOR_DEPTH 24
+        } pixel_format = PixelFormat::ARGB8888;
+
         struct Audio {
-            int sample_rate;
-            int buffer_size;
+            int sample_rate = 44100;
+            int buffer_size = 1024;
 
             struct AudioMute {
                 bool psg[4] { false, false, false, false };
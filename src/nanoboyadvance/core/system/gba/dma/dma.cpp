@@ -145,17 +145,61 @@ namespace Core {
     }
 
     // TODO: FIFO DMA currently ignores DMA priority I think. This should not be the case.
-    void Emulator::dmaTransferFIFO(int dma_id) {
-        auto& dma = regs.dma[dma_id];
+    void Emulator::dmaTransferFIFO(int dma_id, int fifo_id) {
+        auto& dma  = regs.dma[dma_id];
+        auto& fifo = apu.getIO().fifo[fifo_id];
 
-        for (int i = 0; i < 4; i++) {
-            // transfer word to FIFO
-            write32(dma.internal.dst_addr, read32(dma.internal.src_addr, M_DMA), M_DMA);
+        u32 address = dma.internal.src_addr;
+        int page    = (address >> 24) & 15;
+
+        // Sound data comes from RAM or ROM, the 16 bytes are copied straight
+        // into the FIFO instead of being written to FIFO_A/B byte by byte.
+        const u8* source = nullptr;
 
-            // advance source address
-            dma.internal.src_addr += 4;
+        switch (page) {
+            case 0x2: {
+                address &= 0x3FFFF;
+                if (address <= 0x40000 - 16) source = &memory.wram[address];
+                break;
+            }
+            case 0x3: {
+                address &= 0x7FFF;
+                if (address <= 0x8000 - 16) source = &memory.iram[address];
+                break;
+            }
+            case 0x8: case 0x9:
+            case 0xA: case 0xB:
+            case 0xC: case 0xD: {
+                address &= 0x1FFFFFF;
+                bool gpio_overlap = gpio != nullptr && address + 16 > 0xC4 && address <= 0xC8;
+
+                if (address + 16 <= memory.rom.size && !gpio_overlap) {
+                    source = &memory.rom.data[address];
+                }
+                break;
+            }
         }
 
+        if (source != nullptr) {
+            fifo.enqueue(source, 16);
+
+            // four non-sequential word reads and writes
+            cycles_left -= 4 * (cycles32[0][page] + cycles32[0][0x4]);
+        } else {
+            for (int i = 0; i < 4; i++) {
+                u32 word = read32(dma.internal.src_addr + i * 4, M_DMA);
+
+                fifo.enqueue(word & 0xFF);
+                fifo.enqueue((word >> 8)  & 0xFF);
+                fifo.enqueue((word >> 16) & 0xFF);
+                fifo.enqueue((word >> 24) & 0xFF);
+                cycles_left -= cycles32[0][0x4];
+            }
+        }
+
+        // advance source address
+        dma.internal.src_addr += 16;
+
         if (dma.interrupt)
             m_interrupt.request((InterruptType)(INTERRUPT_DMA_0 << dma_id));
     }
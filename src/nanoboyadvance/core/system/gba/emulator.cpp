@@ -17,7 +17,9 @@
   * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
   */
 
+#include <climits>
 #include <cstring>
+#include <algorithm>
 #include <stdexcept>
 
 #include "emulator.hpp"
@@ -57,6 +59,14 @@ namespace Core {
 
         ARM::reset();
 
+        // clear out all memory (before the PPU resyncs its caches)
+        memset(memory.wram,    0, 0x40000);
+        memset(memory.iram,    0, 0x08000);
+        memset(memory.palette, 0, 0x00400);
+        memset(memory.oam,     0, 0x00400);
+        memset(memory.vram,    0, 0x18000);
+        memset(memory.mmio,    0, 0x00800);
+
         // reset PPU und APU state
         ppu.reset();
         apu.reset();
@@ -71,14 +81,6 @@ namespace Core {
             memory.rom.save->reset();
         }
 
-        // clear out all memory
-        memset(memory.wram,    0, 0x40000);
-        memset(memory.iram,    0, 0x08000);
-        memset(memory.palette, 0, 0x00400);
-        memset(memory.oam,     0, 0x00400);
-        memset(memory.vram,    0, 0x18000);
-        memset(memory.mmio,    0, 0x00800);
-
         // reset IO-registers
         regs.irq.enable        = 0;
         regs.irq.flag          = 0;
@@ -122,6 +124,16 @@ namespace Core {
         }
 
         cycles_left = 0;
+
+        m_fifo_overflows[0] = 0;
+        m_fifo_overflows[1] = 0;
+
+        // start of a frame, before the first scanline
+        m_line          = 0;
+        m_phase         = Phase::Active;
+        m_phase_left    = s_cycles_active;
+        m_phase_entered = false;
+
         dma_running = 0;
         dma_current = 0;
         dma_loop_exit = false;
@@ -156,6 +168,10 @@ namespace Core {
         return apu;
     }
 
+    PPU& Emulator::getPPU() {
+        return ppu;
+    }
+
     u16& Emulator::getKeypad() {
         return regs.keyinput;
     }
@@ -169,6 +185,23 @@ namespace Core {
         }
     }
 
+    void Emulator::setInputProvider(InputProvider* input) {
+        m_input = input;
+
+        // poll on the next read
+        m_input_line = m_line_count - 1;
+    }
+
+    void Emulator::updateKeypad() {
+        if (m_input == nullptr || m_input_line == m_line_count) {
+            return;
+        }
+        m_input_line = m_line_count;
+
+        // NOTE: GBA keys work with pull up logic
+        regs.keyinput = ~m_input->poll() & 0x3FF;
+    }
+
     void Emulator::reloadConfig() {
         ppu.reloadConfig();
         apu.reloadConfig();
@@ -187,42 +220,124 @@ namespace Core {
     }
 
     void Emulator::runFrame() {
-        const int VISIBLE_LINES   = 160;
-        const int INVISIBLE_LINES = 68;
-
-        const int CYCLES_ACTIVE = 960;
-        const int CYCLES_HBLANK = 272;
-        const int CYCLES_ENTIRE = CYCLES_ACTIVE + CYCLES_HBLANK;
-
         int frame_count = config->fast_forward ? config->multiplier : 1;
 
         for (int frame = 0; frame < frame_count; frame++) {
-            // 160 visible lines, alternating SCANLINE and HBLANK.
-            for (int line = 0; line < VISIBLE_LINES; line++) {
-                // SCANLINE
-                ppu.scanline(frame == 0);
-                runInternal(CYCLES_ACTIVE);
+            // only the first frame is drawn when fast forwarding
+            m_render = frame == 0;
 
-                // HBLANK
-                ppu.hblank();
-                dmaFindHBlank();
-                runInternal(CYCLES_HBLANK);
+            while (runSlice(INT_MAX, false) != RunResult::FrameEnded) { }
+        }
+        m_render = true;
+    }
+
+    auto Emulator::runFor(int cycles) -> RunResult {
+        return runSlice(cycles, true);
+    }
+
+    auto Emulator::runUntil(u32 deadline) -> RunResult {
+        if (config->clock_us == nullptr) {
+            return runSlice(INT_MAX, true);
+        }
 
-                ppu.nextLine();
-                apu.step(CYCLES_ENTIRE);
+        while (true) {
+            auto result = runSlice(s_cycles_entire, true);
+
+            // unsigned difference, the clock may wrap around
+            if (result != RunResult::SliceEnded ||
+                static_cast<s32>(config->clock_us() - deadline) >= 0) {
+                return result;
             }
+        }
+    }
+
+    auto Emulator::getFrameCycles() const -> int {
+        // every phase ends where its line ends, except for the active part
+        int offset = s_cycles_entire - m_phase_left;
 
-            // 68 invisible lines, VBLANK period.
-            ppu.vblank();
-            dmaFindVBlank();
-            for (int line = 0; line < INVISIBLE_LINES; line++) {
-                runInternal(CYCLES_ENTIRE);
-                ppu.nextLine();
-                apu.step(CYCLES_ENTIRE);
+        if (m_phase == Phase::Active) {
+            offset -= s_cycles_hblank;
+        }
+        return m_line * s_cycles_entire + offset;
+    }
+
+    auto Emulator::runSlice(int cycles, bool stop_on_halt) -> RunResult {
+        while (true) {
+            if (!m_phase_entered) {
+                enterPhase();
+                m_phase_entered = true;
+            }
+
+            int run = std::min(cycles, m_phase_left);
+
+            runInternal(run);
+            cycles       -= run;
+            m_phase_left -= run;
+
+            if (m_phase_left == 0) {
+                m_phase_entered = false;
+
+                if (leavePhase()) {
+                    return RunResult::FrameEnded;
+                }
+            }
+            if (stop_on_halt && regs.haltcnt != SYSTEM_RUN) {
+                return RunResult::Halted;
+            }
+            if (cycles <= 0) {
+                return RunResult::SliceEnded;
             }
         }
     }
 
+    void Emulator::enterPhase() {
+        switch (m_phase) {
+            case Phase::Active:
+                ppu.scanline(m_render);
+                break;
+            case Phase::HBlank:
+                ppu.hblank();
+                dmaFindHBlank();
+                break;
+            case Phase::VBlank:
+                // 68 invisible lines, only the first one starts the VBlank
+                if (m_line == 160) {
+                    ppu.vblank();
+                    dmaFindVBlank();
+                }
+                break;
+        }
+    }
+
+    bool Emulator::leavePhase() {
+        if (m_phase == Phase::Active) {
+            m_phase      = Phase::HBlank;
+            m_phase_left = s_cycles_hblank;
+            return false;
+        }
+
+        ppu.nextLine();
+        apu.step(s_cycles_entire);
+        m_line_count++;
+
+        if (++m_line == 228) {
+            m_line       = 0;
+            m_phase      = Phase::Active;
+            m_phase_left = s_cycles_active;
+            return true;
+        }
+
+        // 160 visible lines, alternating SCANLINE and HBLANK
+        if (m_line < 160) {
+            m_phase      = Phase::Active;
+            m_phase_left = s_cycles_active;
+        } else {
+            m_phase      = Phase::VBlank;
+            m_phase_left = s_cycles_entire;
+        }
+        return false;
+    }
+
     void Emulator::runInternal(int cycles) {
         int cycles_previous;
 
@@ -248,11 +363,13 @@ namespace Core {
                 //TODO: inaccurate because of timer interrupts
                 timerStep(cycles_left);
                 cycles_left = 0;
-                return;
+                break;
             }
 
             timerStep(cycles_previous - cycles_left);
         }
+
+        timerFlushFIFO();
     }
 
     // TODO: consider placing this in memory.hpp?
@@ -24,6 +24,7 @@
 #include "enums.hpp"
 #include "config.hpp"
 #include "interrupt.hpp"
+#include "input.hpp"
 #include "dma/regs.hpp"
 #include "timer/regs.hpp"
 #include "ppu/ppu.hpp"
@@ -45,14 +46,37 @@ namespace Core {
         void reset();
 
         APU& getAPU();
+        PPU& getPPU();
         u16& getKeypad();
         void setKeyState(Key key, bool pressed);
 
+        // Let KEYINPUT reads ask the provider instead, nullptr goes back to setKeyState().
+        void setInputProvider(InputProvider* input);
+
         void reloadConfig();
         void loadGame(std::shared_ptr<Cartridge> cart);
 
         void runFrame();
 
+        enum class RunResult {
+            SliceEnded, // the cycles or the time given are used up
+            FrameEnded, // the last line of a frame is done, the next call starts a new one
+            Halted      // the CPU waits for an interrupt
+        };
+
+        // Runs at least `cycles` cycles (the instruction or DMA crossing the limit is
+        // finished). Stops early at the end of a frame or when the CPU is halted.
+        // Any call continues exactly where the previous one left off.
+        auto runFor(int cycles) -> RunResult;
+
+        // Like runFor(), until the clock in Config::clock_us reaches `deadline`.
+        // The clock is checked about once per scanline. Without a clock the
+        // rest of the frame is run.
+        auto runUntil(u32 deadline) -> RunResult;
+
+        // Cycles since the start of the current frame (280896 per frame).
+        auto getFrameCycles() const -> int;
+
     private:
         Config* config;
 
@@ -61,10 +85,34 @@ namespace Core {
         // Cycles until next PPU phase
         int cycles_left;
 
+        // Position in the frame, see runFor(). Each line has an active and an HBlank
+        // phase, the lines in VBlank have a single one. An event (scanline, HBlank,
+        // VBlank) starts each phase.
+        enum class Phase {
+            Active,
+            HBlank,
+            VBlank
+        };
+
+        int   m_line;
+        Phase m_phase;
+        int   m_phase_left;    // cycles of the phase still to run
+        bool  m_phase_entered; // the event that starts the phase happened
+        bool  m_render = true; // draw the lines of this frame
+
+        void enterPhase();
+        bool leavePhase();
+        auto runSlice(int cycles, bool stop_on_halt) -> RunResult;
+
         // Cycle count LUTs
         int cycles  [2][16];
         int cycles32[2][16];
 
+        // Scanline timing
+        static constexpr int s_cycles_active = 960;
+        static constexpr int s_cycles_hblank = 272;
+        static constexpr int s_cycles_entire = s_cycles_active + s_cycles_hblank;
+
         // Cycle count configurations for different waitstates
         static constexpr int s_ws_nseq[4] = { 4, 3, 2, 8 }; // non-sequential SRAM/WS0/WS1/WS2
         static constexpr int s_ws_seq0[2] = { 2, 1 };       // sequential WS0
@@ -81,6 +129,13 @@ namespace Core {
         APU apu;
         Interrupt m_interrupt;
 
+        // KEYINPUT is read from the provider at most once per scanline
+        InputProvider* m_input = nullptr;
+        u32 m_line_count = 0;
+        u32 m_input_line = 0;
+
+        void updateKeypad();
+
         // Do not delete - needed for reference counting
         std::shared_ptr<Cartridge> cart;
 
@@ -155,7 +210,7 @@ namespace Core {
         void dmaFindHBlank();
         void dmaFindVBlank();
         void dmaTransfer();
-        void dmaTransferFIFO(int dma_id);
+        void dmaTransferFIFO(int dma_id, int fifo_id);
 
         // Timer I/O reset/read/write
         void timerReset(int id);
@@ -168,6 +223,13 @@ namespace Core {
         template <int id>
         void timerRunInternal(int cycles);
         void timerHandleFIFO(int timer_id, int times);
+        void timerFlushFIFO();
+
+        // Overflows of timer 0 and 1 that did not pull FIFO samples yet. They are
+        // handled in one batch at the end of each slice of runInternal. Slices are
+        // at most one PPU phase (1232 cycles), so FIFO pulls, refill DMAs and their
+        // IRQs may come up to a scanline after the overflow that caused them.
+        int m_fifo_overflows[2];
 
         void calculateMemoryCycles();
     protected:
@@ -0,0 +1,85 @@
+/**
+  * Copyright (C) 2018 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include "enums.hpp"
+#include "util/integer.hpp"
+#include "util/spscqueue.hpp"
+
+namespace Core {
+
+    // Source of the keypad state, asked when the game reads KEYINPUT.
+    class InputProvider {
+    public:
+        virtual ~InputProvider() { }
+
+        // Returns the pressed keys as a mask of Key values.
+        virtual auto poll() -> u16 = 0;
+    };
+
+    // Keypad states sampled on another thread, handed over without locks.
+    // Keys pressed in any sample since the last poll are reported as pressed,
+    // so short taps between two KEYINPUT reads are never lost. A release shows
+    // up on the first poll that sees it, not one poll later.
+    class InputQueue : public InputProvider {
+    public:
+        // Adds a sample (producer thread only), ideally only when the keys changed.
+        // @returns  false if the queue is full, the sample is dropped
+        bool push(u16 keys, u32 timestamp) {
+            return m_queue.push({ keys, timestamp });
+        }
+
+        // Consumer thread only.
+        auto poll() -> u16 override {
+            Sample sample;
+
+            // nothing new, the keys are still held as last sampled
+            if (!m_queue.pop(sample)) {
+                return m_keys;
+            }
+
+            u16 keys = 0;
+
+            do {
+                keys     |= sample.keys;
+                m_keys    = sample.keys;
+                m_latest  = sample.timestamp;
+            } while (m_queue.pop(sample));
+
+            return keys;
+        }
+
+        // Timestamp of the latest sample seen by poll(), to measure the latency.
+        auto getTimestamp() const -> u32 {
+            return m_latest;
+        }
+
+    private:
+        struct Sample {
+            u16 keys;
+            u32 timestamp;
+        };
+
+        Util::SPSCQueue<Sample, 64> m_queue;
+
+        u16 m_keys   = 0;
+        u32 m_latest = 0;
+    };
+}
@@ -227,16 +227,30 @@ void busWrite8(u32 address, u8 value, int flags) final {
             writeMMIO(address, value & 0xFF);
             break;
         }
-        case 0x5: WRITE_FAST_16(memory.palette, address & 0x3FF, value * 0x0101); break;
+        case 0x5: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::Palette, address, 2);
+            WRITE_FAST_16(memory.palette, address, value * 0x0101);
+            ppu.onPaletteWrite(address, 2);
+            break;
+        }
         case 0x6: {
             address &= 0x1FFFF;
             if (address >= 0x18000) {
                 address &= ~0x8000;
             }
+            ppu.beforeWrite(PPU::Region::VRAM, address, 2);
             WRITE_FAST_16(memory.vram, address, value * 0x0101);
+            ppu.onVRAMWrite(address, 2);
+            break;
+        }
+        case 0x7: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::OAM, address, 2);
+            WRITE_FAST_16(memory.oam, address, value * 0x0101);
+            ppu.onOAMWrite(address, 2);
             break;
         }
-        case 0x7: WRITE_FAST_16(memory.oam, address & 0x3FF, value * 0x0101); break;
         case 0xE: {
             if (!memory.rom.save || cart->type == SAVE_EEPROM) {
                 break;
@@ -262,16 +276,30 @@ void busWrite16(u32 address, u16 value, int flags) final {
             writeMMIO(address + 1, (value >> 8)  & 0xFF);
             break;
         }
-        case 0x5: WRITE_FAST_16(memory.palette, address & 0x3FF, value); break;
+        case 0x5: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::Palette, address, 2);
+            WRITE_FAST_16(memory.palette, address, value);
+            ppu.onPaletteWrite(address, 2);
+            break;
+        }
         case 0x6: {
             address &= 0x1FFFF;
             if (address >= 0x18000) {
                 address &= ~0x8000;
             }
+            ppu.beforeWrite(PPU::Region::VRAM, address, 2);
             WRITE_FAST_16(memory.vram, address, value);
+            ppu.onVRAMWrite(address, 2);
+            break;
+        }
+        case 0x7: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::OAM, address, 2);
+            WRITE_FAST_16(memory.oam, address, value);
+            ppu.onOAMWrite(address, 2);
             break;
         }
-        case 0x7: WRITE_FAST_16(memory.oam, address & 0x3FF, value); break;
 
         case 0x8: case 0x9:
         case 0xA: case 0xB:
@@ -330,16 +358,30 @@ void busWrite32(u32 address, u32 value, int flags) final {
             writeMMIO(address + 3, (value >> 24) & 0xFF);
             break;
         }
-        case 0x5: WRITE_FAST_32(memory.palette, address & 0x3FF, value); break;
+        case 0x5: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::Palette, address, 4);
+            WRITE_FAST_32(memory.palette, address, value);
+            ppu.onPaletteWrite(address, 4);
+            break;
+        }
         case 0x6: {
             address &= 0x1FFFF;
             if (address >= 0x18000) {
                 address &= ~0x8000;
             }
+            ppu.beforeWrite(PPU::Region::VRAM, address, 4);
             WRITE_FAST_32(memory.vram, address, value);
+            ppu.onVRAMWrite(address, 4);
+            break;
+        }
+        case 0x7: {
+            address &= 0x3FF;
+            ppu.beforeWrite(PPU::Region::OAM, address, 4);
+            WRITE_FAST_32(memory.oam, address, value);
+            ppu.onOAMWrite(address, 4);
             break;
         }
-        case 0x7: WRITE_FAST_32(memory.oam, address & 0x3FF, value); break;
 
         case 0x8: case 0x9:
         case 0xA: case 0xB:
@@ -90,6 +90,8 @@ namespace Core {
             case SOUNDCNT_H:    return apu_io.control.read(2);
             case SOUNDCNT_H+1:  return apu_io.control.read(3);
             case SOUNDCNT_X:    return apu_io.control.read(4);
+            case SOUNDBIAS:     return apu_io.bias.read(0);
+            case SOUNDBIAS+1:   return apu_io.bias.read(1);
 
             // TIMER
             case TM0CNT_L:   return timerRead(0, 0);
@@ -106,8 +108,8 @@ namespace Core {
             case TM3CNT_H:   return timerRead(3, 2);
 
             // JOYPAD
-            case KEYINPUT:   return regs.keyinput & 0xFF;
-            case KEYINPUT+1: return regs.keyinput >> 8;
+            case KEYINPUT:   updateKeypad(); return regs.keyinput & 0xFF;
+            case KEYINPUT+1: updateKeypad(); return regs.keyinput >> 8;
 
             // INTERRUPT
             case IE:    return regs.irq.enable & 0xFF;
@@ -336,6 +338,8 @@ namespace Core {
             case SOUNDCNT_H:   apu_io.control.write(2, value); break;
             case SOUNDCNT_H+1: apu_io.control.write(3, value); break;
             case SOUNDCNT_X:   apu_io.control.write(4, value); break;
+            case SOUNDBIAS:    apu_io.bias.write(0, value); break;
+            case SOUNDBIAS+1:  apu_io.bias.write(1, value); break;
 
             // TIMER
             case TM0CNT_L:   timerWrite(0, 0, value); break;
@@ -0,0 +1,336 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <cstring>
+#include <algorithm>
+#include "ppu.hpp"
+#include "simd.hpp"
+
+namespace Core {
+
+    // Each pixel of the two topmost layers carries a tag next to its color.
+    // Bits 0-2 hold the priority (4 = backdrop), the upper bits are attributes.
+    enum {
+        TAG_PRIO    = 7,
+        TAG_TARGET1 = 8,  // first blend target
+        TAG_TARGET2 = 16, // second blend target
+        TAG_ALPHA   = 32  // semi-transparent OBJ
+    };
+
+    static auto layerMask(const bool* enable) -> u8 {
+        u8 mask = 0;
+
+        for (int layer = 0; layer < 6; layer++) {
+            if (enable[layer]) {
+                mask |= 1 << layer;
+            }
+        }
+        return mask;
+    }
+
+    // One kernel per combination of (windows, special effect, semi-transparent OBJs).
+    const PPU::ComposeKernel PPU::s_compose_kernels[2][4][2] = {
+        {
+            { &PPU::composeLine<false, SFX_NONE    , false>, &PPU::composeLine<false, SFX_NONE    , true> },
+            { &PPU::composeLine<false, SFX_BLEND   , false>, &PPU::composeLine<false, SFX_BLEND   , true> },
+            { &PPU::composeLine<false, SFX_INCREASE, false>, &PPU::composeLine<false, SFX_INCREASE, true> },
+            { &PPU::composeLine<false, SFX_DECREASE, false>, &PPU::composeLine<false, SFX_DECREASE, true> }
+        },
+        {
+            { &PPU::composeLine<true , SFX_NONE    , false>, &PPU::composeLine<true , SFX_NONE    , true> },
+            { &PPU::composeLine<true , SFX_BLEND   , false>, &PPU::composeLine<true , SFX_BLEND   , true> },
+            { &PPU::composeLine<true , SFX_INCREASE, false>, &PPU::composeLine<true , SFX_INCREASE, true> },
+            { &PPU::composeLine<true , SFX_DECREASE, false>, &PPU::composeLine<true , SFX_DECREASE, true> }
+        }
+    };
+
+    void PPU::compose(u32* line_buffer, int bg_min, int bg_max) {
+        const auto& enable = regs.control.enable;
+        const auto& win_enable = regs.control.win_enable;
+
+        // Sort enabled BGs back to front. On equal priority the lower BG number wins.
+        m_layer_count = 0;
+
+        for (int bg = bg_max; bg >= bg_min; bg--) {
+            if (!enable[bg]) {
+                continue;
+            }
+
+            int i = m_layer_count++;
+            int prio = regs.bgcnt[bg].priority;
+
+            for (; i > 0 && regs.bgcnt[m_layers[i - 1]].priority < prio; i--) {
+                m_layers[i] = m_layers[i - 1];
+            }
+            m_layers[i] = bg;
+        }
+
+        bool windows    = win_enable[0] || win_enable[1] || win_enable[2];
+        bool alpha_objs = enable[LAYER_OBJ] && line_has_alpha_objs;
+        int  sfx        = regs.bldcnt.sfx;
+
+        // over the render budget: every layer everywhere, topmost pixel only
+        if (m_reduced) {
+            windows    = false;
+            alpha_objs = false;
+            sfx        = SFX_NONE;
+        }
+
+        if (windows) {
+            renderWindows();
+        }
+
+        (this->*s_compose_kernels[windows][sfx][alpha_objs])(line_buffer);
+    }
+
+    template <bool window, SpecialEffect sfx, bool alpha_objs>
+    void PPU::composeLine(u32* line_buffer) {
+        // Without effects only the topmost layer is of interest.
+        constexpr bool two_layers = sfx != SFX_NONE || alpha_objs;
+
+        u16* color[2] = { m_compose_color[0], m_compose_color[1] };
+        u16* tag  [2] = { m_compose_tag  [0], m_compose_tag  [1] };
+
+        u8 target1 = layerMask(regs.bldcnt.targets[0]);
+        u8 target2 = layerMask(regs.bldcnt.targets[1]);
+
+        auto layerTag = [&](int layer, int prio) -> u16 {
+            return prio | ((target1 >> layer) & 1) * TAG_TARGET1
+                        | ((target2 >> layer) & 1) * TAG_TARGET2;
+        };
+
+        // The backdrop is below everything. An empty second layer is a black backdrop.
+        {
+            u16 backdrop = m_palette[0];
+            u16 bd_tag   = layerTag(LAYER_BD, 4);
+
+            for (int x = 0; x < 240; x++) {
+                color[0][x] = backdrop;
+                tag  [0][x] = bd_tag;
+            }
+            if (two_layers) {
+                for (int x = 0; x < 240; x++) {
+                    color[1][x] = 0;
+                    tag  [1][x] = bd_tag;
+                }
+            }
+        }
+
+        // Draw the BGs back to front, pushing the covered pixel down.
+        for (int i = 0; i < m_layer_count; i++) {
+            int  bg     = m_layers[i];
+            u16  bg_tag = layerTag(bg, regs.bgcnt[bg].priority);
+            u16* buffer = m_buffer[bg];
+
+        #ifdef PPU_SIMD
+            using namespace SIMD;
+
+            u16x8 transparent = splat(COLOR_TRANSPARENT);
+            u16x8 layer_bit   = splat(1 << bg);
+            u16x8 layer_tag   = splat(bg_tag);
+
+            for (int x = 0; x < 240; x += s_lanes) {
+                u16x8 pixel = load(&buffer[x]);
+                u16x8 keep  = equal(pixel, transparent);
+
+                if (window) {
+                    keep = bitOr(keep, equal(bitAnd(loadU8(&m_win_layers[x]), layer_bit), splat(0)));
+                }
+
+                u16x8 color0 = load(&color[0][x]);
+                u16x8 tag0   = load(&tag  [0][x]);
+
+                if (two_layers) {
+                    store(&color[1][x], select(keep, load(&color[1][x]), color0));
+                    store(&tag  [1][x], select(keep, load(&tag  [1][x]), tag0  ));
+                }
+                store(&color[0][x], select(keep, color0, pixel));
+                store(&tag  [0][x], select(keep, tag0  , layer_tag));
+            }
+        #else
+            u8 bg_bit = 1 << bg;
+
+            for (int x = 0; x < 240; x++) {
+                u16 pixel = buffer[x];
+
+                if (pixel == COLOR_TRANSPARENT || (window && !(m_win_layers[x] & bg_bit))) {
+                    continue;
+                }
+                if (two_layers) {
+                    color[1][x] = color[0][x];
+                    tag  [1][x] = tag  [0][x];
+                }
+                color[0][x] = pixel;
+                tag  [0][x] = bg_tag;
+            }
+        #endif
+        }
+
+        // OBJs have a per-pixel priority and are placed in front of BGs with the same priority.
+        if (regs.control.enable[LAYER_OBJ]) {
+            u16 obj_tag = layerTag(LAYER_OBJ, 0);
+
+            for (int x = 0; x < 240; x++) {
+                const auto& obj = m_obj_layer[x];
+
+                if (obj.pixel == COLOR_TRANSPARENT || (window && !(m_win_layers[x] & (1 << LAYER_OBJ)))) {
+                    continue;
+                }
+                if (obj.prio <= (tag[0][x] & TAG_PRIO)) {
+                    if (two_layers) {
+                        color[1][x] = color[0][x];
+                        tag  [1][x] = tag  [0][x];
+                    }
+                    color[0][x] = obj.pixel;
+                    tag  [0][x] = obj_tag | obj.prio | (obj.alpha ? TAG_ALPHA : 0);
+                } else if (two_layers && obj.prio <= (tag[1][x] & TAG_PRIO)) {
+                    color[1][x] = obj.pixel;
+                    tag  [1][x] = obj_tag | obj.prio;
+                }
+            }
+        }
+
+    #ifdef PPU_SIMD
+        using namespace SIMD;
+
+        if (!two_layers) {
+            for (int x = 0; x < 240; x += s_lanes) {
+                storeARGB(&line_buffer[x], load(&color[0][x]), m_pixel_alpha);
+            }
+            return;
+        }
+
+        u16x8 eva = splat(std::min<int>(16, regs.bldalpha.eva));
+        u16x8 evb = splat(std::min<int>(16, regs.bldalpha.evb));
+        u16x8 evy = splat(std::min<int>(16, regs.bldy.evy));
+
+        for (int x = 0; x < 240; x += s_lanes) {
+            u16x8 color0 = load(&color[0][x]);
+            u16x8 color1 = load(&color[1][x]);
+            u16x8 tag0   = load(&tag  [0][x]);
+            u16x8 tag1   = load(&tag  [1][x]);
+
+            u16x8 is_alpha = alpha_objs ? nonZero(bitAnd(tag0, splat(TAG_ALPHA))) : splat(0);
+            u16x8 above    = bitOr(nonZero(bitAnd(tag0, splat(TAG_TARGET1))), is_alpha);
+            u16x8 below    = nonZero(bitAnd(tag1, splat(TAG_TARGET2)));
+            u16x8 pixel    = color0;
+
+            if (sfx != SFX_NONE) {
+                u16x8 apply = above;
+
+                if (sfx == SFX_BLEND) {
+                    apply = bitAnd(apply, below);
+                }
+                if (window) {
+                    apply = bitAnd(apply, bitOr(nonZero(bitAnd(loadU8(&m_win_layers[x]), splat(1 << LAYER_SFX))), is_alpha));
+                }
+
+                switch (sfx) {
+                    case SFX_BLEND:    pixel = select(apply, blend(color0, color1, eva, evb), pixel); break;
+                    case SFX_INCREASE: pixel = select(apply, brighten(color0, evy), pixel); break;
+                    case SFX_DECREASE: pixel = select(apply, darken  (color0, evy), pixel); break;
+                    default: break;
+                }
+            }
+
+            // semi-transparent OBJs force alpha blending if a second target is below
+            if (alpha_objs && sfx != SFX_BLEND) {
+                pixel = select(bitAnd(is_alpha, below), blend(color0, color1, eva, evb), pixel);
+            }
+
+            storeARGB(&line_buffer[x], pixel, m_pixel_alpha);
+        }
+    #else
+        if (!two_layers) {
+            for (int x = 0; x < 240; x++) {
+                line_buffer[x] = rgb555ToARGB(color[0][x]);
+            }
+            return;
+        }
+
+        updateBlendTables();
+
+        for (int x = 0; x < 240; x++) {
+            u16  pixel    = color[0][x];
+            bool is_alpha = alpha_objs && (tag[0][x] & TAG_ALPHA);
+
+            if (!window || (m_win_layers[x] & (1 << LAYER_SFX)) || is_alpha) {
+                bool above = (tag[0][x] & TAG_TARGET1) || is_alpha;
+                bool below =  tag[1][x] & TAG_TARGET2;
+
+                // semi-transparent OBJs force alpha blending if a second target is below
+                if (is_alpha && below) {
+                    blendPixels(&pixel, color[1][x], SFX_BLEND);
+                } else if (sfx != SFX_NONE && above && (below || sfx != SFX_BLEND)) {
+                    blendPixels(&pixel, color[1][x], sfx);
+                }
+            }
+            line_buffer[x] = rgb555ToARGB(pixel);
+        }
+    #endif
+    }
+
+    void PPU::renderWindows() {
+        const auto& win_enable = regs.control.win_enable;
+
+        memset(m_win_layers, layerMask(regs.winout.enable[0]), sizeof(m_win_layers));
+
+        // Lowest window priority first, so that the higher ones overwrite it.
+        if (win_enable[2]) {
+            u8 mask = layerMask(regs.winout.enable[1]);
+
+            for (int x = 0; x < 240; x++) {
+                if (m_obj_layer[x].window) {
+                    m_win_layers[x] = mask;
+                }
+            }
+        }
+        if (win_enable[1]) {
+            renderWindow(1);
+        }
+        if (win_enable[0]) {
+            renderWindow(0);
+        }
+    }
+
+    void PPU::renderWindow(int id) {
+        int   line = regs.vcount;
+        auto& winv = regs.winv[id];
+        auto& winh = regs.winh[id];
+
+        // Check if the current scanline is outside of the window.
+        if ((winv.min <= winv.max && (line < winv.min || line >= winv.max)) ||
+            (winv.min >  winv.max && (line < winv.min && line >= winv.max)))
+        {
+            return;
+        }
+
+        u8  mask = layerMask(regs.winin.enable[id]);
+        int min  = std::min(winh.min, 240);
+        int max  = std::min(winh.max, 240);
+
+        if (winh.min <= winh.max) {
+            memset(&m_win_layers[min], mask, max - min);
+        } else {
+            // the window wraps around the right edge of the screen
+            memset(&m_win_layers[0]  , mask, max);
+            memset(&m_win_layers[min], mask, 240 - min);
+        }
+    }
+}
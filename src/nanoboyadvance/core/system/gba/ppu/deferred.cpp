@@ -0,0 +1,113 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <cstring>
+#include "ppu.hpp"
+
+namespace Core {
+
+    void PPU::recordLine() {
+        // lines are recorded back to back, anything else starts a new batch
+        if (regs.vcount != m_defer_end) {
+            renderDeferred();
+            m_defer_first = m_defer_end = regs.vcount;
+        }
+
+        m_defer_regs[regs.vcount] = regs;
+        m_defer_mark[regs.vcount] = m_write_log.size();
+        m_defer_end++;
+    }
+
+    void PPU::logWrite(Region region, u32 address, int size) {
+        // keep the log bounded, render what is pending (exactly) and start over
+        if (m_write_log.size() >= s_write_log_size) {
+            renderDeferred();
+            return;
+        }
+
+        WriteLogEntry entry;
+
+        entry.region  = region;
+        entry.size    = size;
+        entry.address = address;
+        memcpy(&entry.old_value, getRegionPointer(region) + address, size);
+
+        m_write_log.push_back(entry);
+    }
+
+    auto PPU::getRegionPointer(Region region) -> u8* {
+        switch (region) {
+            case Region::Palette: return m_pal;
+            case Region::VRAM:    return m_vram;
+            default:              return m_oam;
+        }
+    }
+
+    void PPU::applyLogEntry(WriteLogEntry& entry, bool undo) {
+        u8* data = getRegionPointer(entry.region) + entry.address;
+
+        if (undo) {
+            // memory holds the value this write produced, all later writes are undone already
+            memcpy(&entry.new_value, data, entry.size);
+            memcpy(data, &entry.old_value, entry.size);
+        } else {
+            memcpy(data, &entry.new_value, entry.size);
+        }
+
+        switch (entry.region) {
+            case Region::Palette: onPaletteWrite(entry.address, entry.size); break;
+            case Region::VRAM:    onVRAMWrite   (entry.address, entry.size); break;
+            case Region::OAM:     onOAMWrite    (entry.address, entry.size); break;
+        }
+    }
+
+    void PPU::renderDeferred() {
+        if (m_defer_first == m_defer_end) {
+            return;
+        }
+
+        int count = m_write_log.size();
+
+        // roll memory back to where it was when the first pending line was recorded
+        for (int i = count - 1; i >= 0; i--) {
+            applyLogEntry(m_write_log[i], true);
+        }
+
+        IO  live = regs;
+        int next = 0;
+
+        for (int line = m_defer_first; line < m_defer_end; line++) {
+            // replay the writes the CPU made before this line started
+            for (; next < m_defer_mark[line]; next++) {
+                applyLogEntry(m_write_log[next], false);
+            }
+            regs = m_defer_regs[line];
+            drawLine();
+        }
+
+        for (; next < count; next++) {
+            applyLogEntry(m_write_log[next], false);
+        }
+
+        regs = live;
+
+        m_write_log.clear();
+        m_defer_first = m_defer_end;
+    }
+}
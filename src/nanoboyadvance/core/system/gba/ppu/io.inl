@@ -71,8 +71,8 @@ struct IO {
     u16 bgvofs[4];
 
     struct ReferencePoint {
-        u32   value;
-        float internal;
+        u32 value;
+        s32 internal; // current line's reference point, 20.8 fixed point
 
         void reset();
         void write(int offset, u8 value);
@@ -119,9 +119,8 @@ struct IO {
     } bldy;
 
     struct WindowRange {
-        int  min;
-        int  max;
-        bool changed; // only for internal optimization
+        int min;
+        int max;
 
         void reset();
         void write(int offset, u8 value);
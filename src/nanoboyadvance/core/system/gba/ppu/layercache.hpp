@@ -0,0 +1,133 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <vector>
+#include "util/integer.hpp"
+
+namespace Core {
+
+    // Storage for a text BG that is pre-rendered into a 256x256 to 512x512
+    // RGB555 bitmap. Every 8x8 cell remembers the map entry it was drawn from
+    // and the VRAM and palette versions it saw, a tile map row is revalidated
+    // whenever any VRAM or BG palette write happened since it was last checked.
+    // The PPU does the drawing, see PPU::renderTextBGCached().
+    //
+    // Layers that keep redrawing most of their cells are cheaper to render
+    // directly, so the cache steps aside for a while when that happens.
+    class LayerCache {
+    public:
+        struct Cell {
+            int encoder;          // map entry, -1 if never drawn
+            u32 tile_version;     // version of the 2KB block holding the tile
+            u32 palette_version;  // version of the palette bank (or all of BG palette for 8BPP)
+        };
+
+        void reset() {
+            m_key      = -1;
+            m_cooldown = 0;
+            m_frames   = 0;
+            m_redraws  = 0;
+        }
+
+        bool isActive() const {
+            return m_cooldown == 0;
+        }
+
+        // Sets up the bitmap for the given BGxCNT layout and drops its contents if it changed.
+        void configure(int width, int height, int key) {
+            if (key == m_key) {
+                return;
+            }
+            m_key    = key;
+            m_width  = width;
+            m_height = height;
+
+            m_bitmap.resize(width * height);
+            m_cells.assign((width >> 3) * (height >> 3), Cell { -1, 0, 0 });
+            m_checked.assign(height >> 3, RowStamp { ~0u, ~0u });
+        }
+
+        int getWidth()  const { return m_width;  }
+        int getHeight() const { return m_height; }
+
+        auto getLine(int y) -> u16* {
+            return &m_bitmap[y * m_width];
+        }
+
+        auto getCell(int row, int column) -> Cell& {
+            return m_cells[row * (m_width >> 3) + column];
+        }
+
+        // Did VRAM or the BG palette change since the row was last validated?
+        bool isRowCurrent(int row, u32 vram_version, u32 palette_version) const {
+            return m_checked[row].vram    == vram_version &&
+                   m_checked[row].palette == palette_version;
+        }
+
+        void setRowCurrent(int row, u32 vram_version, u32 palette_version) {
+            m_checked[row] = { vram_version, palette_version };
+        }
+
+        void countRedraw() {
+            m_redraws++;
+        }
+
+        // Called once per frame, decides if the cache pays off.
+        void endFrame() {
+            if (m_cooldown != 0) {
+                m_cooldown--;
+                return;
+            }
+            if (++m_frames < s_window) {
+                return;
+            }
+            // A redrawn cell costs about as much as drawing its tile eight times
+            // directly, rendering the whole screen directly takes ~160x31 tile rows.
+            if (m_redraws > s_window * s_max_redraws) {
+                m_cooldown = s_cooldown;
+            }
+            m_frames  = 0;
+            m_redraws = 0;
+        }
+
+    private:
+        static constexpr int s_window      = 16;  // frames per measurement
+        static constexpr int s_max_redraws = 300; // cells per frame, about half of break-even
+        static constexpr int s_cooldown    = 256; // frames to render directly once disabled
+
+        struct RowStamp {
+            u32 vram;
+            u32 palette;
+        };
+
+        int m_key = -1;
+        int m_width;
+        int m_height;
+
+        std::vector<u16>      m_bitmap;
+        std::vector<Cell>     m_cells;
+        std::vector<RowStamp> m_checked;
+
+        int m_cooldown = 0;
+        int m_frames   = 0;
+        int m_redraws  = 0;
+    };
+}
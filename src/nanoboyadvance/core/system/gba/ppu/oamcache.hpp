@@ -0,0 +1,207 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <cstring>
+#include "enums.hpp"
+#include "util/integer.hpp"
+
+namespace Core {
+
+    // Keeps all 128 OAM entries in decoded form, together with a bitmask of
+    // the entries that intersect each visible scanline. OAM writes decode the
+    // touched entries right away and move them between the scanline masks,
+    // so the renderer only ever looks at sprites that are on the current line.
+    class OAMCache {
+    public:
+        struct Object {
+            int  x;           // left edge of the OBJ (not the screen area), -256 to 239
+            int  y;           // top edge of the OBJ, -128 to 159
+            int  width;
+            int  height;
+            int  number;      // first tile (already halved for 256 color OBJs)
+            int  palette;     // 16 to 31
+            int  prio;
+            int  mode;        // ObjectMode
+            int  group;       // rot/scale parameter group
+            bool affine;
+            bool double_size;
+            bool h_flip;
+            bool v_flip;
+            bool is_256;
+            bool mosaic;
+            bool visible;     // neither disabled nor prohibited
+
+            int  first_line;  // scanlines covered by the OBJ screen area, clipped to 0-159
+            int  last_line;
+        };
+
+        OAMCache(u8* oam) : m_oam(oam) {
+            invalidate();
+        }
+
+        // Redecodes all of OAM.
+        void invalidate() {
+            memset(m_line_mask, 0, sizeof(m_line_mask));
+            m_version++;
+
+            for (int i = 0; i < 128; i++) {
+                m_objects[i].visible = false;
+                decode(i);
+            }
+        }
+
+        void markDirty(u32 address, int size) {
+            m_version++;
+
+            int first = (address & 0x3FF) >> 3;
+            int last  = ((address + size - 1) & 0x3FF) >> 3;
+
+            decode(first);
+            if (last != first) {
+                decode(last);
+            }
+        }
+
+        auto getObject(int index) const -> const Object& {
+            return m_objects[index];
+        }
+
+        // Returns PA, PB, PC and PD (8.8 fixed point) of a rot/scale parameter group.
+        auto getParameters(int group) const -> const s16* {
+            return m_parameters[group];
+        }
+
+        // Returns a counter that changes on any OAM write.
+        auto getVersion() const -> u32 {
+            return m_version;
+        }
+
+        // Calls func(index) for every OBJ on the given line, from the last OAM entry to the first.
+        template <typename F>
+        void forEachOnLine(int line, F func) const {
+            for (int word = 3; word >= 0; word--) {
+                u32 bits = m_line_mask[line][word];
+
+                while (bits != 0) {
+                    int bit = 31 - __builtin_clz(bits);
+
+                    func((word << 5) | bit);
+                    bits &= ~(1u << bit);
+                }
+            }
+        }
+
+    private:
+        static constexpr int s_obj_size[4][4][2] = {
+            /* SQUARE */
+            { { 8 , 8  }, { 16, 16 }, { 32, 32 }, { 64, 64 } },
+            /* HORIZONTAL */
+            { { 16, 8  }, { 32, 8  }, { 32, 16 }, { 64, 32 } },
+            /* VERTICAL */
+            { { 8 , 16 }, { 8 , 32 }, { 16, 32 }, { 32, 64 } },
+            /* PROHIBITED */
+            { { 0 , 0  }, { 0 , 0  }, { 0 , 0  }, { 0 , 0  } }
+        };
+
+        u8* m_oam;
+
+        Object m_objects[128];
+        s16    m_parameters[32][4];
+
+        // one bit per OAM entry for each visible scanline
+        u32 m_line_mask[160][4];
+
+        u32 m_version = 0;
+
+        void setLines(int index, bool set) {
+            auto& object = m_objects[index];
+            u32   bit    = 1u << (index & 31);
+
+            for (int line = object.first_line; line <= object.last_line; line++) {
+                if (set) {
+                    m_line_mask[line][index >> 5] |=  bit;
+                } else {
+                    m_line_mask[line][index >> 5] &= ~bit;
+                }
+            }
+        }
+
+        void decode(int index) {
+            u8* entry  = &m_oam[index << 3];
+            auto& object = m_objects[index];
+
+            u16 attribute0 = (entry[1] << 8) | entry[0];
+            u16 attribute1 = (entry[3] << 8) | entry[2];
+            u16 attribute2 = (entry[5] << 8) | entry[4];
+
+            // the fourth halfword of each entry belongs to a rot/scale group
+            m_parameters[index >> 2][index & 3] = (entry[7] << 8) | entry[6];
+
+            if (object.visible) {
+                setLines(index, false);
+            }
+
+            int shape = attribute0 >> 14;
+            int size  = attribute1 >> 14;
+
+            object.x  = attribute1 & 0x1FF;
+            object.y  = attribute0 & 0x0FF;
+
+            if (object.x >= 240) object.x -= 512;
+            if (object.y >= 160) object.y -= 256;
+
+            object.width       = s_obj_size[shape][size][0];
+            object.height      = s_obj_size[shape][size][1];
+            object.prio        = (attribute2 >> 10) & 3;
+            object.mode        = (attribute0 >> 10) & 3;
+            object.mosaic      = attribute0 & (1 << 12);
+            object.is_256      = attribute0 & (1 << 13);
+            object.affine      = attribute0 & (1 << 8);
+            object.double_size = object.affine && (attribute0 & (1 << 9));
+            object.h_flip      = !object.affine && (attribute1 & (1 << 12));
+            object.v_flip      = !object.affine && (attribute1 & (1 << 13));
+            object.group       = (attribute1 >> 9) & 0x1F;
+            object.number      = attribute2 & 0x3FF;
+            object.palette     = (attribute2 >> 12) + 16;
+
+            if (object.is_256) {
+                object.number >>= 1;
+            }
+
+            // non-affine OBJs with bit 9 set are disabled
+            bool disabled = !object.affine && (attribute0 & (1 << 9));
+
+            object.visible = !disabled && object.mode != OBJ_PROHIBITED;
+
+            if (object.visible) {
+                int height = object.double_size ? (object.height << 1) : object.height;
+
+                object.first_line = object.y < 0 ? 0 : object.y;
+                object.last_line  = object.y + height - 1;
+
+                if (object.last_line > 159) {
+                    object.last_line = 159;
+                }
+                setLines(index, true);
+            }
+        }
+    };
+}
@@ -0,0 +1,331 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <vector>
+#include "util/integer.hpp"
+
+namespace Core {
+
+    // LRU cache of regular (non-affine) OBJs decoded to RGB555, with flipping
+    // already applied. Entries are keyed by everything that affects their
+    // pixels except VRAM and palette contents, which are checked through
+    // version counters whenever an entry is used. The PPU does the drawing,
+    // see PPU::getCachedObject().
+    //
+    // All memory is set up when the budget changes, a miss never allocates.
+    // Pixels live in 8KB slabs, each slab is split into blocks of one OBJ size
+    // (64 8x8 blocks down to one 64x64 block) and goes back to the pool once
+    // all of its blocks were evicted. The budget is rounded down to whole slabs.
+    class ObjectCache {
+    public:
+        struct Entry {
+            u32 key;
+            u32 vram_version;     // sum of the versions of the VRAM blocks it was drawn from
+            u32 palette_version;
+            int width;
+            u16* pixels;
+        };
+
+        struct Stats {
+            u32 hits;
+            u32 misses;
+            u32 evictions;
+            u32 size;             // bytes of pixel data held
+        };
+
+        // Builds the key of an OBJ, see OAMCache::Object.
+        static u32 makeKey(int number, int palette, int width, int height,
+                           bool is_256, bool h_flip, bool v_flip, bool one_dimensional) {
+            return  number                   |
+                   ((palette & 15)    << 10) |
+                   ((width  >> 3) - 1) << 14 |
+                   ((height >> 3) - 1) << 17 |
+                   (is_256          << 20)   |
+                   (h_flip          << 21)   |
+                   (v_flip          << 22)   |
+                   (one_dimensional << 23);
+        }
+
+        void setBudget(u32 bytes) {
+            int slabs = bytes / s_slab_bytes;
+
+            if (slabs != m_slab_count) {
+                allocate(slabs);
+            }
+        }
+
+        bool isEnabled() const {
+            return m_slab_count != 0;
+        }
+
+        void reset() {
+            clear();
+            m_stats = { 0, 0, 0, 0 };
+        }
+
+        // Returns the entry for key and marks it as most recently used.
+        // New entries carry zero versions, so the caller's version check draws them.
+        // Each OAM entry remembers its last result, which skips the hash lookup.
+        auto get(int index, u32 key, int width, int height) -> Entry& {
+            auto& slot = m_slots[index];
+
+            if (slot.key == key && slot.generation == m_generation) {
+                touch(slot.node);
+                m_stats.hits++;
+                return m_nodes[slot.node].entry;
+            }
+
+            int node = find(key);
+
+            if (node != -1) {
+                touch(node);
+                m_stats.hits++;
+            } else {
+                node = insert(key, width, height);
+                m_stats.misses++;
+            }
+
+            slot = { key, m_generation, node };
+
+            return m_nodes[node].entry;
+        }
+
+        auto getStats() const -> const Stats& {
+            return m_stats;
+        }
+
+    private:
+        static constexpr int s_slab_pixels = 64 * 64; // the largest OBJ
+        static constexpr int s_slab_bytes  = s_slab_pixels * sizeof(u16);
+        static constexpr int s_min_pixels  = 8 * 8;   // one block of the smallest size class
+
+        struct Node {
+            Entry entry;
+            int prev;   // LRU list, -1 at either end
+            int next;   // also links unused nodes
+            int chain;  // next node in the same hash bucket
+            int slab;
+            int block;
+            u32 bytes;
+        };
+
+        struct Slab {
+            int size_class; // blocks of s_min_pixels << size_class, -1 while unused
+            u64 free;       // one bit per block
+        };
+
+        int m_slab_count = 0;
+
+        std::vector<u16>  m_pool;
+        std::vector<Slab> m_slabs;
+        std::vector<Node> m_nodes;   // one per block of the smallest size
+        std::vector<int>  m_buckets; // first node of each hash chain
+
+        int m_bucket_bits = 0;
+        int m_head = -1;             // most recently used
+        int m_tail = -1;
+        int m_free_node = -1;
+
+        Stats m_stats = { 0, 0, 0, 0 };
+
+        // last entry used by each OAM entry, valid while generation matches
+        struct Slot {
+            u32 key;
+            u32 generation;
+            int node;
+        } m_slots[128] = {};
+
+        u32 m_generation = 1;
+
+        static int getSizeClass(int pixels) {
+            int size_class = 0;
+
+            while ((s_min_pixels << size_class) < pixels) {
+                size_class++;
+            }
+            return size_class;
+        }
+
+        static u64 getFullMask(int size_class) {
+            int blocks = (s_slab_pixels / s_min_pixels) >> size_class;
+
+            return blocks == 64 ? ~0ULL : (1ULL << blocks) - 1;
+        }
+
+        int getBucket(u32 key) const {
+            return (key * 2654435761u) >> (32 - m_bucket_bits);
+        }
+
+        void allocate(int slabs) {
+            int nodes = slabs * (s_slab_pixels / s_min_pixels);
+
+            m_bucket_bits = 1;
+            while ((1 << m_bucket_bits) < nodes) {
+                m_bucket_bits++;
+            }
+
+            m_slab_count = slabs;
+            m_pool    = std::vector<u16> (slabs * s_slab_pixels);
+            m_slabs   = std::vector<Slab>(slabs);
+            m_nodes   = std::vector<Node>(nodes);
+            m_buckets = std::vector<int> (slabs != 0 ? (1 << m_bucket_bits) : 0);
+
+            clear();
+        }
+
+        void clear() {
+            for (auto& slab : m_slabs) {
+                slab = { -1, 0 };
+            }
+            for (auto& bucket : m_buckets) {
+                bucket = -1;
+            }
+            for (int i = 0; i < (int)m_nodes.size(); i++) {
+                m_nodes[i].next = i + 1 < (int)m_nodes.size() ? i + 1 : -1;
+            }
+            m_free_node = m_nodes.empty() ? -1 : 0;
+            m_head = -1;
+            m_tail = -1;
+            m_stats.size = 0;
+            m_generation++;
+        }
+
+        int find(u32 key) const {
+            int node = m_buckets[getBucket(key)];
+
+            while (node != -1 && m_nodes[node].entry.key != key) {
+                node = m_nodes[node].chain;
+            }
+            return node;
+        }
+
+        void unlink(int node) {
+            auto& n = m_nodes[node];
+
+            (n.prev != -1 ? m_nodes[n.prev].next : m_head) = n.next;
+            (n.next != -1 ? m_nodes[n.next].prev : m_tail) = n.prev;
+        }
+
+        void pushFront(int node) {
+            auto& n = m_nodes[node];
+
+            n.prev = -1;
+            n.next = m_head;
+            (m_head != -1 ? m_nodes[m_head].prev : m_tail) = node;
+            m_head = node;
+        }
+
+        void touch(int node) {
+            if (node != m_head) {
+                unlink(node);
+                pushFront(node);
+            }
+        }
+
+        // Takes a free block of the size class, from a slab of that size or an unused one.
+        bool allocateBlock(int size_class, int& slab, int& block) {
+            int unused = -1;
+
+            for (int i = 0; i < m_slab_count; i++) {
+                auto& s = m_slabs[i];
+
+                if (s.size_class == size_class && s.free != 0) {
+                    slab  = i;
+                    block = __builtin_ctzll(s.free);
+                    s.free &= s.free - 1;
+                    return true;
+                }
+                if (s.size_class == -1 && unused == -1) {
+                    unused = i;
+                }
+            }
+
+            if (unused == -1) {
+                return false;
+            }
+
+            m_slabs[unused] = { size_class, getFullMask(size_class) & ~1ULL };
+            slab  = unused;
+            block = 0;
+            return true;
+        }
+
+        int insert(u32 key, int width, int height) {
+            int size_class = getSizeClass(width * height);
+            int slab;
+            int block;
+
+            // Freeing every block empties every slab, so this always ends.
+            while (!allocateBlock(size_class, slab, block)) {
+                evictOldest();
+            }
+
+            int   node   = m_free_node;
+            auto& n      = m_nodes[node];
+            u16*  pixels = &m_pool[slab * s_slab_pixels + (block * s_min_pixels << size_class)];
+
+            m_free_node = n.next;
+
+            n.entry = { key, 0, 0, width, pixels };
+            n.slab  = slab;
+            n.block = block;
+            n.bytes = width * height * sizeof(u16);
+
+            int& bucket = m_buckets[getBucket(key)];
+
+            n.chain = bucket;
+            bucket  = node;
+
+            pushFront(node);
+            m_stats.size += n.bytes;
+
+            return node;
+        }
+
+        // Drops the least recently used entry and hands its block back to its slab.
+        void evictOldest() {
+            int   node = m_tail;
+            auto& n    = m_nodes[node];
+            auto& slab = m_slabs[n.slab];
+
+            unlink(node);
+
+            int* link = &m_buckets[getBucket(n.entry.key)];
+
+            while (*link != node) {
+                link = &m_nodes[*link].chain;
+            }
+            *link = n.chain;
+
+            slab.free |= 1ULL << n.block;
+            if (slab.free == getFullMask(slab.size_class)) {
+                slab.size_class = -1;
+            }
+
+            n.next = m_free_node;
+            m_free_node = node;
+
+            m_stats.size -= n.bytes;
+            m_stats.evictions++;
+            m_generation++;
+        }
+    };
+}
@@ -18,8 +18,10 @@
   */
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include "ppu.hpp"
+#include "renderthread.hpp"
 #include "util/logger.hpp"
 
 using namespace Util;
@@ -30,33 +32,80 @@ namespace Core {
             m_config (config),
             m_pal    (pram),
             m_oam    (oam),
-            m_vram   (vram)
+            m_vram   (vram),
+            m_tile_cache(vram),
+            m_oam_cache(oam)
     {
         reset();
         reloadConfig();
-
-        // Generate blending LUT (TODO: make table static)
-        for (int color0 = 0; color0 <= 31; color0++)
-        for (int color1 = 0; color1 <= 31; color1++)
-        for (int factor0 = 0; factor0 <= 16; factor0++)
-        for (int factor1 = 0; factor1 <= 16; factor1++) {
-            int result = (color0 * factor0 + color1 * factor1) >> 4;
-            blend_table[factor0][factor1][color0][color1] = std::min<u8>(result, 31);
-        }
     }
 
+    // out of line, RenderThread is incomplete in the header
+    PPU::~PPU() = default;
+
     void PPU::reloadConfig() {
+        // lines recorded so far are rendered with the old settings
+        renderDeferred();
+
         m_frameskip   = m_config->frameskip;
         m_framebuffer = m_config->framebuffer;
+        m_output      = m_config->video_output;
 
-        // build color conversion LUT
-        for (int color = 0; color < 0x8000; color++) {
-            int r = (color >> 0 ) & 0x1F;
-            int g = (color >> 5 ) & 0x1F;
-            int b = (color >> 10) & 0x1F;
+        // new frames start out zeroed, which is version 0 of every line
+        if (m_config->frames != m_frames) {
+            m_frames = m_config->frames;
 
-            m_color_lut[color] = 0xFF000000 | (b << 3) | (g << 11) | (r << 19);
+            for (int line = 0; line < 160; line++) {
+                m_line_version[line] = 0;
+                m_line_source [line] = nullptr;
+            }
+        }
+
+        m_layer_cache_enable = m_config->bg_layer_cache;
+        m_obj_cache.setBudget(m_config->obj_cache_size);
+        m_skip_unchanged = m_config->skip_unchanged_lines;
+
+        m_interlace     = m_config->interlace;
+        m_clock         = m_config->clock_us;
+        m_render_budget = (m_clock != nullptr) ? m_config->render_budget : 0;
+
+    #ifdef PPU_RENDER_THREAD
+        if (m_config->render_thread && !m_threaded) {
+            m_render_thread.reset(new RenderThread(m_config, m_pal, m_oam, m_vram));
+            m_render_thread->getPPU().takeFrameState(*this);
+            m_threaded = true;
+        } else if (m_config->render_thread) {
+            m_render_thread->reloadConfig();
+        } else if (m_threaded) {
+            m_render_thread->waitIdle();
+            takeFrameState(m_render_thread->getPPU());
+
+            // our own caches went stale while the worker was rendering
+            m_render_thread.reset();
+            m_threaded = false;
+            invalidateCaches();
         }
+    #endif
+
+        // a render thread takes care of the lines as they come
+        m_deferred = m_config->deferred_rendering && !m_threaded;
+
+        // the output may have moved or changed its format
+        invalidateLines();
+
+        // precalculate nearest neighbour mapping for the scaled output
+        if (m_output.buffer != nullptr) {
+            m_scaler.configure(240, 160, m_output.width, m_output.height, m_output.scale_mode);
+        }
+
+        m_pixel_alpha = (m_config->pixel_format == Config::PixelFormat::ARGB8888) ? 0xFF000000 : 0;
+    }
+
+    void PPU::setFrameskip(int frameskip) {
+        m_frameskip = frameskip;
+
+        // the next frame is drawn
+        m_frame_counter = 0;
     }
 
     void PPU::reset() {
@@ -100,6 +149,66 @@ namespace Core {
 
         m_frame_counter = 0;
         line_has_alpha_objs = false;
+
+        // modes 3 and 5 compose the OBJ layer without ever rendering it
+        for (auto& pixel : m_obj_layer) {
+            pixel = { 4, COLOR_TRANSPARENT, false, false };
+        }
+
+        // pending lines refer to memory that is about to be reset
+        m_defer_first = m_defer_end = 0;
+        m_write_log.clear();
+        m_write_log.reserve(s_write_log_size);
+
+        m_frame_changed = m_last_frame_changed = true;
+        m_frame_started = false;
+        m_render_stats  = { 0, 0, 0, 0, 0 };
+
+        m_field   = 0;
+        m_reduced = false;
+        invalidateLines();
+
+        // force the blending LUTs to be rebuilt
+        m_blend_eva = m_blend_evb = m_blend_evy = -1;
+
+        if (m_threaded) {
+        #ifdef PPU_RENDER_THREAD
+            m_render_thread->resync();
+        #endif
+        } else {
+            invalidateCaches();
+        }
+    }
+
+    void PPU::invalidateCaches() {
+        m_tile_cache.invalidate();
+        m_oam_cache.invalidate();
+        m_obj_cache.reset();
+
+        for (int i = 0; i < 4; i++) {
+            m_map_row[i].valid = false;
+            m_layer_cache[i].reset();
+        }
+        onPaletteWrite(0, 0x400);
+    }
+
+    void PPU::forwardWrite(Region region, u32 address, int size) {
+    #ifdef PPU_RENDER_THREAD
+        m_render_thread->pushWrite(region, address, size);
+    #endif
+    }
+
+    auto PPU::getRenderer() -> PPU& {
+    #ifdef PPU_RENDER_THREAD
+        if (m_threaded) {
+            return m_render_thread->getPPU();
+        }
+    #endif
+        return *this;
+    }
+
+    auto PPU::getRenderer() const -> const PPU& {
+        return const_cast<PPU*>(this)->getRenderer();
     }
 
     void PPU::setInterruptController(Interrupt* interrupt) {
@@ -115,6 +224,9 @@ namespace Core {
     }
 
     void PPU::vblank() {
+        // render the lines recorded during this frame in one go
+        renderDeferred();
+
         regs.status.vblank_flag = true;
         regs.status.hblank_flag = false;
 
@@ -123,8 +235,16 @@ namespace Core {
         regs.bgx[1].internal = PPU::decodeFixed32(regs.bgx[1].value);
         regs.bgy[1].internal = PPU::decodeFixed32(regs.bgy[1].value);
 
-        if (m_config->frameskip != 0) {
-            m_frame_counter = (m_frame_counter + 1) % m_config->frameskip;
+        if (m_threaded) {
+        #ifdef PPU_RENDER_THREAD
+            m_render_thread->finishFrame();
+        #endif
+        } else {
+            finishFrame();
+        }
+
+        if (m_frameskip != 0) {
+            m_frame_counter = (m_frame_counter + 1) % m_frameskip;
         }
 
         if (regs.status.vblank_interrupt) {
@@ -144,257 +264,251 @@ namespace Core {
         regs.bgy[1].internal += PPU::decodeFixed16(regs.bgpd[1]);
 
         if (render && (m_frameskip == 0 || m_frame_counter == 0)) {
-            u16 backdrop_color = *(u16*)(m_pal); // TODO: endianess
-            u32* line_buffer   = &m_framebuffer[regs.vcount * 240];
+            if (m_threaded) {
+            #ifdef PPU_RENDER_THREAD
+                m_render_thread->pushLine(regs);
+            #endif
+            } else if (m_deferred) {
+                recordLine();
+            } else {
+                drawLine();
+            }
+        }
+    }
+
+    void PPU::finishFrame() {
+        for (int i = 0; i < 4; i++) {
+            m_layer_cache[i].endFrame();
+        }
 
-            // Simulate forced blank and bail out early
-            if (regs.control.forced_blank) {
-                u32* line = m_framebuffer + regs.vcount * 240;
+        // the next frame draws the other half of the lines and starts at full quality
+        if (m_frame_started) {
+            m_field ^= 1;
+            m_frame_started = false;
+            m_reduced = false;
+        }
 
-                for (int x = 0; x < 240; x++) {
-                    line[x] = rgb555ToARGB(0x7FFF);
-                }
-                return;
+        if (m_frame_changed) {
+            m_render_stats.frames_rendered++;
+        } else {
+            m_render_stats.frames_skipped++;
+        }
+        if (m_frames != nullptr && m_frame_changed) {
+            publishFrame();
+        }
+
+        m_last_frame_changed = m_frame_changed;
+        m_frame_changed = false;
+    }
+
+    void PPU::drawLine() {
+        // the other field keeps the pixels of the previous frame
+        if (m_interlace && (regs.vcount & 1) != m_field) {
+            return;
+        }
+        checkRenderBudget();
+
+        // the output still holds this line from an earlier frame
+        if (m_skip_unchanged && isLineUnchanged()) {
+            m_render_stats.lines_skipped++;
+            return;
+        }
+        u32* line_buffer;
+
+        if (m_frames != nullptr) {
+            line_buffer = &m_frames->back().pixels[regs.vcount * 240];
+        } else if (m_output.buffer != nullptr) {
+            line_buffer = m_line;
+        } else {
+            line_buffer = &m_framebuffer[regs.vcount * 240];
+        }
+
+        renderLine(line_buffer);
+        m_render_stats.lines_rendered++;
+
+        if (m_reduced) {
+            // draw the line properly once there is time again
+            m_line_state[regs.vcount].valid = false;
+            m_render_stats.lines_reduced++;
+        }
+
+        // same pixels as last time, neither scale nor report it
+        if (m_skip_unchanged && isOutputUnchanged(line_buffer)) {
+            if (m_frames != nullptr) {
+                storeFrameLine(false);
             }
+            return;
+        }
+        if (m_frames != nullptr) {
+            storeFrameLine(true);
+        } else if (m_output.buffer != nullptr) {
+            m_scaler.scaleLine(m_line, regs.vcount, m_output.buffer, m_output.stride);
+        }
+        m_line_dirty[regs.vcount] = true;
+        m_frame_changed = true;
+    }
 
-            // Render window masks
-            if (regs.control.win_enable[0]) {
-                renderWindow(0);
+    void PPU::storeFrameLine(bool changed) {
+        auto& frame = m_frames->back();
+        int   line  = regs.vcount;
+
+        if (changed) {
+            m_line_version[line]++;
+        }
+        frame.version[line] = m_line_version[line];
+        m_line_source[line] = &frame;
+    }
+
+    void PPU::publishFrame() {
+        auto& frame = m_frames->back();
+
+        // lines that were skipped or not drawn still hold an older frame
+        for (int line = 0; line < 160; line++) {
+            if (frame.version[line] != m_line_version[line]) {
+                memcpy(&frame.pixels[line * 240], &m_line_source[line]->pixels[line * 240], 240 * sizeof(u32));
+                frame.version[line] = m_line_version[line];
             }
-            if (regs.control.win_enable[1]) {
-                renderWindow(1);
+        }
+        m_frames->publish();
+    }
+
+    void PPU::takeFrameState(const PPU& other) {
+        for (int line = 0; line < 160; line++) {
+            m_line_version[line] = other.m_line_version[line];
+            m_line_source [line] = other.m_line_source [line];
+        }
+    }
+
+    void PPU::checkRenderBudget() {
+        if (!m_frame_started) {
+            m_frame_started = true;
+
+            if (m_render_budget != 0) {
+                m_frame_start = m_clock();
             }
+            return;
+        }
 
-            #define DECLARE_VARS_NO_SFX \
-                int current_prio = 4;\
-                u16 out_pixel    = backdrop_color;
+        // unsigned difference, the clock may wrap around
+        if (m_render_budget != 0 && !m_reduced) {
+            m_reduced = (m_clock() - m_frame_start) > m_render_budget;
+        }
+    }
 
-            #define IS_SUITABLE_BG_NO_SFX (enable[bg] && bgcnt[bg].priority <= current_prio)
+    bool PPU::isOutputUnchanged(const u32* line_buffer) {
+        auto& state = m_line_state[regs.vcount];
 
-            #define SUITABLE_BG_NO_SFX_INNER \
-                u16 pixel;\
-                pixel = m_buffer[bg][x];\
-                if (pixel != COLOR_TRANSPARENT) {\
-                    out_pixel    = pixel;\
-                    current_prio = bgcnt[bg].priority;\
-                }
+        // two independent 32-bit hashes, cheaper than a 64-bit one on the V5
+        u32 a = 2166136261u;
+        u32 b = 0;
 
-            #define IS_OBJ_PIXEL_NO_SFX (enable[LAYER_OBJ] && m_obj_layer[x].prio <= current_prio)
+        for (int x = 0; x < 240; x++) {
+            a = (a ^ line_buffer[x]) * 16777619u;
+            b = (b + line_buffer[x]) * 2654435761u;
+        }
 
-            #define OBJ_PIXEL_NO_SFX_INNER \
-                u16 pixel = m_obj_layer[x].pixel;\
-                if (pixel != COLOR_TRANSPARENT) {\
-                    line_buffer[x] = rgb555ToARGB(pixel);\
-                    continue;\
-                }
+        u64 hash = (static_cast<u64>(a) << 32) | b;
 
-            #define DECLARE_SFX_VARS \
-                int layer[2] = { LAYER_BD, LAYER_BD };\
-                u16 pixel[2] = { backdrop_color, 0  };
+        if (state.has_output && state.output_hash == hash) {
+            return true;
+        }
+        state.has_output  = true;
+        state.output_hash = hash;
 
-            #define IS_SUITABLE_BG_SFX (enable[bg] && bgcnt[bg].priority == prio)
+        return false;
+    }
 
-            #define SUITABLE_BG_SFX_INNER \
-                u16 new_pixel = m_buffer[bg][x];\
-                if (new_pixel != COLOR_TRANSPARENT) {\
-                    layer[1] = layer[0];\
-                    layer[0] = bg;\
-                    pixel[1] = pixel[0];\
-                    pixel[0] = new_pixel;\
-                }
+    bool PPU::isLineUnchanged() {
+        auto& state = m_line_state[regs.vcount];
 
-            #define IS_OBJ_PIXEL_SFX (enable[LAYER_OBJ] && m_obj_layer[x].prio == prio)
+        u32 vram_version    = m_tile_cache.getVersion();
+        u32 oam_version     = m_oam_cache.getVersion();
+        u32 palette_version = m_palette_version[0] + m_palette_version[1];
 
-            #define OBJ_PIXEL_SFX_INNER \
-                u16 new_pixel = m_obj_layer[x].pixel;\
-                if (new_pixel != COLOR_TRANSPARENT) {\
-                    layer[1] = layer[0];\
-                    layer[0] = LAYER_OBJ;\
-                    pixel[1] = pixel[0];\
-                    pixel[0] = new_pixel;\
-                }
+        if (state.valid &&
+            state.vram_version    == vram_version &&
+            state.oam_version     == oam_version  &&
+            state.palette_version == palette_version &&
+            memcmp(&state.regs, &regs, sizeof(IO)) == 0) {
+            return true;
+        }
 
-            #define PERFORM_SFX_EFFECT \
-                auto sfx          = regs.bldcnt.sfx;\
-                bool is_alpha_obj = layer[0] == LAYER_OBJ && m_obj_layer[x].alpha;\
-                bool sfx_above    = regs.bldcnt.targets[0][layer[0]] || is_alpha_obj;\
-                bool sfx_below    = regs.bldcnt.targets[1][layer[1]];\
-                \
-                if (is_alpha_obj && sfx_below) {\
-                    sfx = SFX_BLEND;\
-                }\
-                \
-                if (sfx != SFX_NONE && sfx_above && (sfx_below || sfx != SFX_BLEND)) {\
-                    blendPixels(&pixel[0], pixel[1], sfx);\
-                }
+        state.valid           = true;
+        state.vram_version    = vram_version;
+        state.oam_version     = oam_version;
+        state.palette_version = palette_version;
+        memcpy(&state.regs, &regs, sizeof(IO));
 
-            #define DECLARE_WIN_VARS \
-                const auto& outside  = regs.winout.enable[0];\
-                const auto& win0in   = regs.winin.enable[0];\
-                const auto& win1in   = regs.winin.enable[1];\
-                const auto& objwinin = regs.winout.enable[1];\
-
-            #define DECLARE_WIN_VARS_INNER \
-                const bool win0   = win_enable[0] && m_win_scanline_enable[0] && m_win_mask[0][x];\
-                const bool win1   = win_enable[1] && m_win_scanline_enable[1] && m_win_mask[1][x];\
-                const bool objwin = win_enable[2] && m_obj_layer[x].window;\
-                \
-                const bool* visible = win0   ? win0in   :\
-                                      win1   ? win1in   :\
-                                      objwin ? objwinin : outside;
-
-            #define  BG_IS_IN_WINDOW visible[bg]
-            #define OBJ_IS_IN_WINDOW visible[LAYER_OBJ]
-
-            #define LOOP_LINE \
-                for (int x = 0; x < 240; x++)
-
-            #define LOOP_PRIO \
-                for (int prio = 3; prio >= 0; prio--)
-
-            #define LOOP_BG_MODE_0 \
-                for (int bg = 3; bg >= 0; bg--)
-
-            #define LOOP_BG_MODE_1 \
-                for (int bg = 2; bg >= 0; bg--)
-
-            #define LOOP_BG_MODE_2 \
-                for (int bg = 3; bg >= 2; bg--)
-
-            #define LOOP_BG_MODE_3_4_5 \
-                int bg = 2;
-
-            const auto& bgcnt  = regs.bgcnt;
-            const auto& enable = regs.control.enable;
-
-            auto win_enable = regs.control.win_enable;
-            bool no_windows = !win_enable[0] && !win_enable[1] && !win_enable[2];
-            bool no_effects = (regs.bldcnt.sfx == SFX_NONE) && !line_has_alpha_objs;
-
-            #define COMPOSE(custom_bg_loop) \
-                if (no_windows && no_effects) {\
-                    LOOP_LINE {\
-                        DECLARE_VARS_NO_SFX;\
-                        custom_bg_loop {\
-                            if (IS_SUITABLE_BG_NO_SFX) {\
-                                SUITABLE_BG_NO_SFX_INNER;\
-                            }\
-                        }\
-                        if (IS_OBJ_PIXEL_NO_SFX) {\
-                            OBJ_PIXEL_NO_SFX_INNER;\
-                        }\
-                        line_buffer[x] = rgb555ToARGB(out_pixel);\
-                    }\
-                }\
-                else if (!no_windows &&  no_effects) {\
-                    DECLARE_WIN_VARS;\
-                    DECLARE_VARS_NO_SFX;\
-                    LOOP_LINE {\
-                        DECLARE_VARS_NO_SFX;\
-                        DECLARE_WIN_VARS_INNER\
-                        custom_bg_loop {\
-                            if (IS_SUITABLE_BG_NO_SFX && BG_IS_IN_WINDOW) {\
-                                SUITABLE_BG_NO_SFX_INNER;\
-                            }\
-                        }\
-                        if (IS_OBJ_PIXEL_NO_SFX && OBJ_IS_IN_WINDOW) {\
-                            OBJ_PIXEL_NO_SFX_INNER;\
-                        }\
-                        line_buffer[x] = rgb555ToARGB(out_pixel);\
-                    }\
-                }\
-                else if ( no_windows && !no_effects) {\
-                    DECLARE_WIN_VARS;\
-                    LOOP_LINE {\
-                        DECLARE_SFX_VARS;\
-                        DECLARE_WIN_VARS_INNER;\
-                        LOOP_PRIO {\
-                            custom_bg_loop {\
-                                if (IS_SUITABLE_BG_SFX) {\
-                                    SUITABLE_BG_SFX_INNER;\
-                                }\
-                            }\
-                            if (IS_OBJ_PIXEL_SFX) {\
-                                OBJ_PIXEL_SFX_INNER;\
-                            }\
-                        }\
-                        PERFORM_SFX_EFFECT;\
-                        line_buffer[x] = rgb555ToARGB(pixel[0]);\
-                    }\
-                }\
-                else {\
-                    DECLARE_WIN_VARS;\
-                    LOOP_LINE {\
-                        DECLARE_SFX_VARS;\
-                        DECLARE_WIN_VARS_INNER;\
-                        LOOP_PRIO {\
-                            custom_bg_loop {\
-                                if (IS_SUITABLE_BG_SFX && BG_IS_IN_WINDOW) {\
-                                    SUITABLE_BG_SFX_INNER;\
-                                }\
-                            }\
-                            if (IS_OBJ_PIXEL_SFX && OBJ_IS_IN_WINDOW) {\
-                                OBJ_PIXEL_SFX_INNER;\
-                            }\
-                        }\
-                        if (visible[LAYER_SFX] || (layer[0] == LAYER_OBJ && m_obj_layer[x].alpha)) {\
-                            PERFORM_SFX_EFFECT;\
-                        }\
-                        line_buffer[x] = rgb555ToARGB(pixel[0]);\
-                    }\
-                }
+        return false;
+    }
 
-            switch (regs.control.mode) {
-                case 0: {
-                    // BG Mode 0 - 240x160 pixels, Text mode
-                    if (regs.control.enable[0]) renderTextBG(0);
-                    if (regs.control.enable[1]) renderTextBG(1);
-                    if (regs.control.enable[2]) renderTextBG(2);
-                    if (regs.control.enable[3]) renderTextBG(3);
-                    if (regs.control.enable[4]) renderSprites();
-                    COMPOSE(LOOP_BG_MODE_0);
-                    break;
-                }
-                case 1:
-                    // BG Mode 1 - 240x160 pixels, Text and RS mode mixed
-                    if (regs.control.enable[0]) renderTextBG(0);
-                    if (regs.control.enable[1]) renderTextBG(1);
-                    if (regs.control.enable[2]) renderAffineBG(0);
-                    if (regs.control.enable[4]) renderSprites();
-                    COMPOSE(LOOP_BG_MODE_1);
-                    break;
-                case 2:
-                    // BG Mode 2 - 240x160 pixels, RS mode
-                    if (regs.control.enable[2]) renderAffineBG(0);
-                    if (regs.control.enable[3]) renderAffineBG(1);
-                    if (regs.control.enable[4]) renderSprites();
-                    COMPOSE(LOOP_BG_MODE_2);
-                    break;
-                case 3:
-                    // BG Mode 3 - 240x160 pixels, 32768 colors
-                    if (regs.control.enable[2]) {
-                        renderBitmapMode1BG();
-                    }
-                    COMPOSE(LOOP_BG_MODE_3_4_5);
-                    break;
-                case 4:
-                    // BG Mode 4 - 240x160 pixels, 256 colors (out of 32768 colors)
-                    if (regs.control.enable[2]) {
-                        renderBitmapMode2BG();
-                    }
-                    if (regs.control.enable[4]) {
-                        renderSprites();
-                    }
-                    COMPOSE(LOOP_BG_MODE_3_4_5);
-                    break;
-                case 5:
-                    // BG Mode 5 - 160x128 pixels, 32768 colors
-                    if (regs.control.enable[2]) {
-                        renderBitmapMode3BG();
-                    }
-                    COMPOSE(LOOP_BG_MODE_3_4_5);
-                    break;
+    void PPU::invalidateLines() {
+        for (int i = 0; i < 160; i++) {
+            m_line_dirty[i] = false;
+            m_line_state[i].valid      = false;
+            m_line_state[i].has_output = false;
+        }
+    }
+
+    void PPU::renderLine(u32* line_buffer) {
+        // Simulate forced blank and bail out early
+        if (regs.control.forced_blank) {
+            for (int x = 0; x < 240; x++) {
+                line_buffer[x] = rgb555ToARGB(0x7FFF);
             }
+            return;
+        }
+
+        switch (regs.control.mode) {
+            case 0: {
+                // BG Mode 0 - 240x160 pixels, Text mode
+                if (regs.control.enable[0]) renderTextBG(0);
+                if (regs.control.enable[1]) renderTextBG(1);
+                if (regs.control.enable[2]) renderTextBG(2);
+                if (regs.control.enable[3]) renderTextBG(3);
+                if (regs.control.enable[4]) renderSprites();
+                compose(line_buffer, 0, 3);
+                break;
+            }
+            case 1:
+                // BG Mode 1 - 240x160 pixels, Text and RS mode mixed
+                if (regs.control.enable[0]) renderTextBG(0);
+                if (regs.control.enable[1]) renderTextBG(1);
+                if (regs.control.enable[2]) renderAffineBG(0);
+                if (regs.control.enable[4]) renderSprites();
+                compose(line_buffer, 0, 2);
+                break;
+            case 2:
+                // BG Mode 2 - 240x160 pixels, RS mode
+                if (regs.control.enable[2]) renderAffineBG(0);
+                if (regs.control.enable[3]) renderAffineBG(1);
+                if (regs.control.enable[4]) renderSprites();
+                compose(line_buffer, 2, 3);
+                break;
+            case 3:
+                // BG Mode 3 - 240x160 pixels, 32768 colors
+                if (regs.control.enable[2]) {
+                    renderBitmapMode1BG();
+                }
+                compose(line_buffer, 2, 2);
+                break;
+            case 4:
+                // BG Mode 4 - 240x160 pixels, 256 colors (out of 32768 colors)
+                if (regs.control.enable[2]) {
+                    renderBitmapMode2BG();
+                }
+                if (regs.control.enable[4]) {
+                    renderSprites();
+                }
+                compose(line_buffer, 2, 2);
+                break;
+            case 5:
+                // BG Mode 5 - 160x128 pixels, 32768 colors
+                if (regs.control.enable[2]) {
+                    renderBitmapMode3BG();
+                }
+                compose(line_buffer, 2, 2);
+                break;
         }
     }
 
@@ -409,35 +523,26 @@ namespace Core {
         }
     }
 
-    void PPU::renderWindow(int id) {
-        int   line = regs.vcount;
-        auto& winv = regs.winv[id];
+    void PPU::updateBlendTables() {
+        int eva = std::min<int>(16, regs.bldalpha.eva);
+        int evb = std::min<int>(16, regs.bldalpha.evb);
+        int evy = std::min<int>(16, regs.bldy.evy);
 
-        // Check if the current scanline is outside of the window.
-        if ((winv.min <= winv.max && (line < winv.min || line >= winv.max)) ||
-            (winv.min >  winv.max && (line < winv.min && line >= winv.max)))
-        {
-            // Mark window as inactive during the current scanline.
-            m_win_scanline_enable[id] = false;
-        } else {
-            auto& winh = regs.winh[id];
-
-            // Mark window as active during the current scanline.
-            m_win_scanline_enable[id] = true;
-
-            // Only recalculate the LUTs if min/max changed between the last update & now.
-            if (winh.changed) {
-                if (winh.min <= winh.max) {
-                    for (int x = 0; x < 240; x++) {
-                        m_win_mask[id][x] = x >= winh.min && x < winh.max;
-                    }
-                } else {
-                    for (int x = 0; x < 240; x++) {
-                        m_win_mask[id][x] = x >= winh.min || x < winh.max;
-                    }
-                }
-                winh.changed = false;
+        if (eva != m_blend_eva || evb != m_blend_evb) {
+            for (int color0 = 0; color0 <= 31; color0++)
+            for (int color1 = 0; color1 <= 31; color1++) {
+                m_blend_alpha[color0][color1] = std::min((color0 * eva + color1 * evb) >> 4, 31);
+            }
+            m_blend_eva = eva;
+            m_blend_evb = evb;
+        }
+
+        if (evy != m_blend_evy) {
+            for (int color = 0; color <= 31; color++) {
+                m_blend_brighten[color] = color + (((31 - color) * evy) >> 4);
+                m_blend_darken  [color] = (color * (16 - evy)) >> 4;
             }
+            m_blend_evy = evy;
         }
     }
 
@@ -448,32 +553,25 @@ namespace Core {
 
         switch (sfx) {
             case SFX_BLEND: {
-                int eva = std::min<int>(16, regs.bldalpha.eva);
-                int evb = std::min<int>(16, regs.bldalpha.evb);
-
                 int r2 = (target2 >> 0 ) & 0x1F;
                 int g2 = (target2 >> 5 ) & 0x1F;
                 int b2 = (target2 >> 10) & 0x1F;
 
-                r1 = blend_table[eva][evb][r1][r2];
-                g1 = blend_table[eva][evb][g1][g2];
-                b1 = blend_table[eva][evb][b1][b2];
+                r1 = m_blend_alpha[r1][r2];
+                g1 = m_blend_alpha[g1][g2];
+                b1 = m_blend_alpha[b1][b2];
                 break;
             }
             case SFX_INCREASE: {
-                int evy = std::min<int>(16, regs.bldy.evy);
-
-                r1 = blend_table[16 - evy][evy][r1][31];
-                g1 = blend_table[16 - evy][evy][g1][31];
-                b1 = blend_table[16 - evy][evy][b1][31];
+                r1 = m_blend_brighten[r1];
+                g1 = m_blend_brighten[g1];
+                b1 = m_blend_brighten[b1];
                 break;
             }
             case SFX_DECREASE: {
-                int evy = std::min<int>(16, regs.bldy.evy);
-
-                r1 = blend_table[16 - evy][evy][r1][0];
-                g1 = blend_table[16 - evy][evy][g1][0];
-                b1 = blend_table[16 - evy][evy][b1][0];
+                r1 = m_blend_darken[r1];
+                g1 = m_blend_darken[g1];
+                b1 = m_blend_darken[b1];
                 break;
             }
             default: break;
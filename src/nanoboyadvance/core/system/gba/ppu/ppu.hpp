@@ -19,17 +19,33 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
 #include "enums.hpp"
+#include "tilecache.hpp"
+#include "oamcache.hpp"
+#include "layercache.hpp"
+#include "objcache.hpp"
 #include "util/integer.hpp"
+#include "util/scaler.hpp"
 #include "../interrupt.hpp"
 #include "../config.hpp"
 
 #define PPU_INCLUDE
 
+// The render thread needs std::thread, which the V5 toolchain does not provide.
+#if defined(__linux__) || defined(_WIN32) || defined(__APPLE__)
+    #define PPU_RENDER_THREAD
+#endif
+
 namespace Core {
     const u16 COLOR_TRANSPARENT = 0x8000;
 
+    class RenderThread;
+
     class PPU {
+        friend class RenderThread;
+
     private:
         u8* m_pal;
         u8* m_oam;
@@ -40,19 +56,81 @@ namespace Core {
         u32* m_framebuffer;
         Config* m_config;
 
+        // direct scaled output (see Config::VideoOutput)
+        Config::VideoOutput m_output;
+        Util::Scaler        m_scaler;
+        u32 m_line[240];
+
+        // Frames published to another thread (see Config::frames). Each line has a
+        // version that changes along with its pixels and the frame that holds them.
+        Util::TripleBuffer<Frame>* m_frames = nullptr;
+        u32          m_line_version[160];
+        const Frame* m_line_source[160];
+
+        // unpacked VRAM tiles
+        TileCache m_tile_cache;
+
+        // decoded OAM and the OBJs on each scanline
+        OAMCache m_oam_cache;
+
+        // Decoded tile map row of each text BG. All eight scanlines of a tile row
+        // share it, it is rebuilt when the map row, BGxCNT or the screen blocks change.
+        struct MapRow {
+            struct Entry {
+                u32  address;   // first byte of the tile in VRAM
+                u16  encoder;   // raw map entry, identical entries decode identically
+                u8   palette;
+                bool h_flip;
+                bool v_flip;
+            } entries[64];
+
+            bool valid;
+            int  width;         // 32 or 64 entries
+            int  row;
+            int  map_block;
+            int  tile_block;
+            int  screen_size;
+            bool full_palette;
+            int  block[2];      // screen blocks read and their versions
+            u32  version[2];
+        } m_map_row[4];
+
+        // optional pre-rendered text BGs (see Config::bg_layer_cache)
+        bool       m_layer_cache_enable;
+        LayerCache m_layer_cache[4];
+
+        // palette RAM as RGB555 colors, updated on palette RAM writes
+        u16 m_palette[512];
+
+        // write counters for the BG and OBJ palettes as a whole and for each 16 color bank
+        u32 m_palette_version[2] = {};
+        u32 m_palette_bank_version[32] = {};
+
         // rendering buffers
-        u16  m_buffer[4][240];
-        bool m_win_mask[2][240];
-        bool m_win_scanline_enable[2];
+        u16 m_buffer[4][240];
+        u8  m_win_layers[240]; // visible layers (bitmask) for each pixel
 
-        // color conversion LUT
-        u32 m_color_lut[0x8000];
+        // compositor state: enabled BGs back to front and the two topmost layers
+        int m_layer_count;
+        int m_layers[4];
+        u16 m_compose_color[2][240];
+        u16 m_compose_tag  [2][240];
 
-        // LUT for fast (alpha) blend calculation
-        u8 blend_table[17][17][32][32];
+        u32 m_pixel_alpha; // top byte of each output pixel
+
+        // blending LUTs for the current BLDALPHA/BLDY values, see updateBlendTables()
+        int m_blend_eva;
+        int m_blend_evb;
+        int m_blend_evy;
+        u8  m_blend_alpha[32][32];
+        u8  m_blend_brighten[32];
+        u8  m_blend_darken[32];
 
         bool line_has_alpha_objs;
 
+        // decoded regular OBJs (see Config::obj_cache_size)
+        ObjectCache m_obj_cache;
+
         struct ObjectPixel {
             u8   prio;
             u16  pixel;
@@ -65,28 +143,238 @@ namespace Core {
         #include "io.inl"
         #include "ppu.inl"
 
+    public:
+        struct RenderStats {
+            u32 lines_rendered;
+            u32 lines_skipped;
+            u32 frames_rendered; // frames that changed the output
+            u32 frames_skipped;  // frames that left the output untouched
+            u32 lines_reduced;   // rendered without blending and windows
+        };
+
+    private:
+        // Inputs each visible line was last rendered from and a hash of its pixels
+        // (see Config::skip_unchanged_lines). Equal versions mean VRAM, OAM and
+        // palette RAM were not written since.
+        struct LineState {
+            bool valid;
+            u32  vram_version;
+            u32  oam_version;
+            u32  palette_version;
+            IO   regs;
+
+            bool has_output;
+            u64  output_hash;
+        } m_line_state[160];
+
+        // lines that changed since the last collectDirtyRows()
+        bool m_line_dirty[160];
+
+        bool m_skip_unchanged;
+        bool m_frame_started;      // a line of the current frame was drawn
+        bool m_frame_changed;      // current frame so far
+        bool m_last_frame_changed; // last completed frame
+        RenderStats m_render_stats;
+
+        // cheaper rendering under load (see Config::interlace and Config::render_budget)
+        bool m_interlace;
+        int  m_field;              // parity of the lines drawn this frame
+        u32  m_render_budget;
+        u32  (*m_clock)();
+        u32  m_frame_start;        // clock value at the first line of the frame
+        bool m_reduced;            // the rest of the frame skips blending and windows
+
+        bool isLineUnchanged();
+        bool isOutputUnchanged(const u32* line_buffer);
+        void invalidateLines();
+        void checkRenderBudget();
+
+    public:
+        enum class Region {
+            Palette,
+            VRAM,
+            OAM
+        };
+
+    private:
+        // Deferred rendering (see Config::deferred_rendering): visible lines only
+        // record the registers, memory writes made while lines are pending are
+        // logged with their old value. At VBlank memory is rolled back and the
+        // lines are rendered while the writes are replayed in order.
+        struct WriteLogEntry {
+            Region region;
+            int    size;
+            u32    address;
+            u32    old_value;
+            u32    new_value;   // filled in when rolling back
+        };
+
+        static constexpr size_t s_write_log_size = 4096;
+
+        bool m_deferred;
+        int  m_defer_first;       // pending lines
+        int  m_defer_end;
+        IO   m_defer_regs[160];
+        int  m_defer_mark[160];   // log entries made before each line started
+        std::vector<WriteLogEntry> m_write_log;
+
+        // rendering happens on a RenderThread, see Config::render_thread
+        bool m_threaded = false;
+    #ifdef PPU_RENDER_THREAD
+        std::unique_ptr<RenderThread> m_render_thread;
+    #endif
+
+        void forwardWrite(Region region, u32 address, int size);
+        auto getRenderer() -> PPU&;
+        auto getRenderer() const -> const PPU&;
+
+        void drawLine();
+        void storeFrameLine(bool changed);
+        void finishFrame();
+        void publishFrame();
+        void takeFrameState(const PPU& other);
+        void invalidateCaches();
+        void recordLine();
+        void logWrite(Region region, u32 address, int size);
+        auto getRegionPointer(Region region) -> u8*;
+        void applyLogEntry(WriteLogEntry& entry, bool undo);
+        void renderDeferred();
+
+        auto getMapRow(int id, int row) -> const MapRow&;
         void renderTextBG(int id);
+        void renderTextBGCached(int id);
+        void drawLayerCell(int id, int row, int column, const MapRow::Entry& entry);
         void renderAffineBG(int id);
         void renderBitmapMode1BG();
         void renderBitmapMode2BG();
         void renderBitmapMode3BG();
         void renderSprites();
+        auto getCachedObject(int index, const OAMCache::Object& object) -> const u16*;
 
+        void renderLine(u32* line_buffer);
+
+        using ComposeKernel = void (PPU::*)(u32*);
+
+        static const ComposeKernel s_compose_kernels[2][4][2];
+
+        void compose(u32* line_buffer, int bg_min, int bg_max);
+
+        template <bool window, SpecialEffect sfx, bool alpha_objs>
+        void composeLine(u32* line_buffer);
+
+        void renderWindows();
         void renderWindow(int id);
+        void updateBlendTables();
         void blendPixels(u16* target1, u16 target2, SpecialEffect sfx);
 
     public:
         PPU(Config* config, u8* pram, u8* oam, u8* vram);
+       ~PPU();
 
         void reset();
         void reloadConfig();
 
+        // Changes the frameskip without reloading the rest of the config.
+        void setFrameskip(int frameskip);
+
         IO& getIO() {
             return regs;
         }
 
         void setInterruptController(Interrupt* interrupt);
 
+        auto getObjectCacheStats() const -> const ObjectCache::Stats& {
+            return getRenderer().m_obj_cache.getStats();
+        }
+
+        auto getRenderStats() const -> const RenderStats& {
+            return getRenderer().m_render_stats;
+        }
+
+        // Did the last frame change any pixel of the output?
+        bool frameChanged() const {
+            return getRenderer().m_last_frame_changed;
+        }
+
+        // Calls func(first, last) for each run of output rows (inclusive, relative to
+        // the output buffer) that changed since the previous call, then clears them.
+        template <typename F>
+        void collectDirtyRows(F func) {
+            auto& m_line_dirty = getRenderer().m_line_dirty;
+
+            int line = 0;
+
+            while (line < 160) {
+                if (!m_line_dirty[line]) {
+                    line++;
+                    continue;
+                }
+
+                int first = line;
+
+                while (line < 160 && m_line_dirty[line]) {
+                    m_line_dirty[line++] = false;
+                }
+
+                if (m_output.buffer != nullptr) {
+                    int row_first = m_scaler.rowOf(first);
+                    int row_last  = m_scaler.rowOf(line) - 1;
+
+                    // lines that are dropped when scaling down cover no rows
+                    if (row_last >= row_first) {
+                        func(row_first, row_last);
+                    }
+                } else {
+                    func(first, line - 1);
+                }
+            }
+        }
+
+        // Must be called right before every CPU or DMA write to palette RAM, VRAM or OAM.
+        void beforeWrite(Region region, u32 address, int size) {
+            if (m_defer_first != m_defer_end) {
+                logWrite(region, address, size);
+            }
+        }
+
+        // Must be called on every CPU or DMA write to VRAM to keep caches coherent.
+        void onVRAMWrite(u32 address, int size) {
+            if (m_threaded) {
+                forwardWrite(Region::VRAM, address, size);
+                return;
+            }
+            m_tile_cache.markDirty(address, size);
+        }
+
+        // Must be called on every CPU or DMA write to OAM.
+        void onOAMWrite(u32 address, int size) {
+            if (m_threaded) {
+                forwardWrite(Region::OAM, address, size);
+                return;
+            }
+            m_oam_cache.markDirty(address, size);
+        }
+
+        // Must be called on every CPU or DMA write to palette RAM.
+        void onPaletteWrite(u32 address, int size) {
+            if (m_threaded) {
+                forwardWrite(Region::Palette, address, size);
+                return;
+            }
+
+            int first = address >> 1;
+            int last  = (address + size - 1) >> 1;
+
+            for (int i = first; i <= last; i++) {
+                int entry = i & 0x1FF;
+
+                m_palette[entry] = ((m_pal[(entry << 1) | 1] << 8) | m_pal[entry << 1]) & 0x7FFF;
+
+                m_palette_version[entry >> 8]++;
+                m_palette_bank_version[entry >> 4]++;
+            }
+        }
+
         void hblank();
         void vblank();
         void scanline(bool render);
@@ -28,68 +28,51 @@ namespace Core {
         auto bg        = regs.bgcnt[2 + id];
         u16* buffer    = m_buffer[2 + id];
         u32 tile_block = bg.tile_block << 14;
+        u32 map_block  = bg.map_block << 11;
 
-        float ref_x = regs.bgx[id].internal;
-        float ref_y = regs.bgy[id].internal;
-        float parameter_a = PPU::decodeFixed16(regs.bgpa[id]);
-        float parameter_c = PPU::decodeFixed16(regs.bgpc[id]);
+        // all coordinates are 20.8 fixed point, each pixel just adds PA/PC
+        s32 ref_x = regs.bgx[id].internal;
+        s32 ref_y = regs.bgy[id].internal;
+        s32 parameter_a = PPU::decodeFixed16(regs.bgpa[id]);
+        s32 parameter_c = PPU::decodeFixed16(regs.bgpc[id]);
 
-        int size, block_width;
+        // 128, 256, 512 or 1024 pixels, 16 to 128 tiles
+        int size_shift  = 7 + bg.screen_size;
+        int size        = 1 << size_shift;
+        int block_shift = size_shift - 3;
 
-        switch (bg.screen_size) {
-            case 0: size = 128; block_width = 16; break;
-            case 1: size = 256; block_width = 32; break;
-            case 2: size = 512; block_width = 64; break;
-            case 3: size = 1024; block_width = 128; break;
-        }
+        auto fetch = [&](int x, int y) -> u16 {
+            int number = m_vram[map_block + ((y >> 3) << block_shift) + (x >> 3)];
+            int index  = m_vram[tile_block + (number << 6) + ((y & 7) << 3) + (x & 7)];
 
-        for (int _x = 0; _x < 240; _x++) {
-            bool is_backdrop = false;
+            return (index == 0) ? COLOR_TRANSPARENT : readPaletteEntry(0, index);
+        };
 
-            int x = ref_x + _x * parameter_a;
-            int y = ref_y + _x * parameter_c;
+        if (bg.wraparound) {
+            int mask = size - 1;
 
-            if (x >= size) {
-                if (bg.wraparound) {
-                    x = x % size;
-                } else {
-                    is_backdrop = true;
-                }
-            } else if (x < 0) {
-                if (bg.wraparound) {
-                    x = (size + x) % size;
-                } else {
-                    is_backdrop = true;
-                }
+            for (int _x = 0; _x < 240; _x++) {
+                buffer[_x] = fetch((ref_x >> 8) & mask, (ref_y >> 8) & mask);
+
+                ref_x += parameter_a;
+                ref_y += parameter_c;
             }
+        } else {
+            for (int _x = 0; _x < 240; _x++) {
+                int x = ref_x >> 8;
+                int y = ref_y >> 8;
 
-            if (y >= size) {
-                if (bg.wraparound) {
-                    y = y % size;
+                // negative coordinates wrap to huge unsigned values
+                if (static_cast<u32>(x) >= static_cast<u32>(size) ||
+                    static_cast<u32>(y) >= static_cast<u32>(size)) {
+                    buffer[_x] = COLOR_TRANSPARENT;
                 } else {
-                    is_backdrop = true;
+                    buffer[_x] = fetch(x, y);
                 }
-            } else if (y < 0) {
-                if (bg.wraparound) {
-                    y = (size + y) % size;
-                } else {
-                    is_backdrop = true;
-                }
-            }
 
-            if (is_backdrop) {
-                buffer[_x] = COLOR_TRANSPARENT;
-                continue;
+                ref_x += parameter_a;
+                ref_y += parameter_c;
             }
-
-            int map_x  = x >> 3;
-            int map_y  = y >> 3;
-            int tile_x = x & 7;
-            int tile_y = y & 7;
-
-            int number = m_vram[(bg.map_block << 11) + map_y * block_width + map_x];
-
-            buffer[_x] = getTilePixel8BPP(tile_block, 0, number, tile_x, tile_y);
         }
     }
 }
@@ -17,50 +17,15 @@
   * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
   */
 
+#include <algorithm>
 #include "../ppu.hpp"
 #include "util/logger.hpp"
 
 namespace Core {
 
-    static constexpr int g_obj_size[4][4][2] = {
-        /* SQUARE */
-        {
-            { 8 , 8  },
-            { 16, 16 },
-            { 32, 32 },
-            { 64, 64 }
-        },
-        /* HORIZONTAL */
-        {
-            { 16, 8  },
-            { 32, 8  },
-            { 32, 16 },
-            { 64, 32 }
-        },
-        /* VERTICAL */
-        {
-            { 8 , 16 },
-            { 8 , 32 },
-            { 16, 32 },
-            { 32, 64 }
-        },
-        /* PROHIBITED */
-        {
-            { 0, 0 },
-            { 0, 0 },
-            { 0, 0 },
-            { 0, 0 }
-        }
-    };
-
     void PPU::renderSprites() {
         const u32 tile_base = 0x10000;
 
-        // affine 2x2 matrix
-        s16 pa, pb, pc, pd;
-
-        u32 offset = 127 << 3;
-
         // (semi) eh...
         line_has_alpha_objs = false;
         for (int i = 0; i < 240; i++) {
@@ -72,165 +37,207 @@ namespace Core {
             obj.window = false;
         }
 
-        // TODO(performance):
-        // we have to read OAM data in descending order but that
-        // might affect dcache performance? not sure about impact.
-        for (int i = 0; i < 128; i++) {
-            // TODO(performance): decode these on OAM writes already?
-            u16 attribute0 = (m_oam[offset + 1] << 8) | m_oam[offset + 0];
-            u16 attribute1 = (m_oam[offset + 3] << 8) | m_oam[offset + 2];
-            u16 attribute2 = (m_oam[offset + 5] << 8) | m_oam[offset + 4];
-
-            int width, height;
-            s32 x = attribute1 & 0x1FF;
-            int y = attribute0 & 0x0FF;
-            int shape   = attribute0 >> 14;
-            int size    = attribute1 >> 14;
-            int prio    = (attribute2 >> 10) & 3;
-            int mode    = (attribute0 >> 10) & 3;
-            bool mosaic = attribute0 & (1 << 12);
-
-            if (mode == OBJ_PROHIBITED) {
-                offset -= 8;
-                continue;
-            }
+        int line = regs.vcount;
 
-            // can this be done more efficiently?
-            if (x >= 240) x -= 512;
-            if (y >= 160) y -= 256;
+        // OAM is decoded on write, only OBJs on this line are visited (last entry first).
+        m_oam_cache.forEachOnLine(line, [&](int index) {
+            const auto& object = m_oam_cache.getObject(index);
 
-            bool affine    = attribute0 & (1<<8);
-            bool attr0bit9 = attribute0 & (1<<9);
+            int  width   = object.width;
+            int  height  = object.height;
+            int  prio    = object.prio;
+            int  mode    = object.mode;
+            int  palette = object.is_256 ? 16 : object.palette;
+            bool is_256  = object.is_256;
 
-            // check if OBJ is disabled
-            if (!affine && attr0bit9) {
-                offset -= 8;
-                continue;
-            }
+            // tiles to skip from one row of tiles to the next
+            int row_stride = regs.control.one_dimensional ? (width >> 3) : (is_256 ? 16 : 32);
 
-            // get width and height of OBJ
-            width  = g_obj_size[shape][size][0];
-            height = g_obj_size[shape][size][1];
+            auto getTileRow = [&](int block_x, int block_y, int tile_y) -> const u8* {
+                int tile_num = object.number + block_y * row_stride + block_x;
 
-            int rect_width  = width;
-            int rect_height = height;
+                if (is_256) {
+                    return m_tile_cache.getRow8BPP(tile_base + (tile_num << 6), tile_y);
+                }
+                return m_tile_cache.getRow4BPP(tile_base + (tile_num << 5), tile_y);
+            };
+
+            auto plot = [&](int screen_x, u16 pixel) {
+                auto& p = m_obj_layer[screen_x];
+
+                // second condition seems counter-intuitive but 0 = highest, 3 = lowest priority
+                if (mode == OBJ_WINDOW) {
+                    p.window = true;
+                } else if (prio <= p.prio) {
+                    p.prio   = prio;
+                    p.pixel  = pixel;
+                    p.alpha  = mode == OBJ_SEMI;
+                    if (p.alpha) {
+                        line_has_alpha_objs = true;
+                    }
+                }
+            };
 
-            // move x/y to the *center* of the OBJ
-            x += width  >> 1;
-            y += height >> 1;
+            if (!object.affine && m_obj_cache.isEnabled()) {
+                // regular OBJs: copy the row straight out of the decoded (and flipped) OBJ
+                const u16* row = getCachedObject(index, object) + (line - object.y) * width;
 
-            // read rot/scale parameters
-            if (affine) {
-                int group = ((attribute1 >> 9) & 0x1F) << 5;
+                int x_min = std::max(object.x, 0);
+                int x_max = std::min(object.x + width, 240);
 
-                pa = (m_oam[group + 0x7 ] << 8) | m_oam[group + 0x6 ];
-                pb = (m_oam[group + 0xF ] << 8) | m_oam[group + 0xE ];
-                pc = (m_oam[group + 0x17] << 8) | m_oam[group + 0x16];
-                pd = (m_oam[group + 0x1F] << 8) | m_oam[group + 0x1E];
+                for (int x = x_min; x < x_max; x++) {
+                    u16 pixel = row[x - object.x];
+                    if (pixel != COLOR_TRANSPARENT) plot(x, pixel);
+                }
+                return;
+            }
 
-                // double-size bit
-                if (attr0bit9) {
-                    x += width  >> 1;
-                    y += height >> 1;
+            if (!object.affine) {
+                // regular OBJs: copy whole tile rows, clipped against the screen once
+                int tex_y = line - object.y;
 
-                    rect_width  <<= 1;
-                    rect_height <<= 1;
+                if (object.v_flip) {
+                    tex_y = height - tex_y - 1;
                 }
 
-            } else {
-                // initialize P with identity matrix:
-                // [ 1  0 ]
-                // [ 0  1 ]
-                pa = 0x100;
-                pb = 0;
-                pc = 0;
-                pd = 0x100;
+                int blocks   = width >> 3;
+                int x_min    = std::max(object.x, 0);
+                int x_max    = std::min(object.x + width, 240);
+
+                for (int block = (x_min - object.x) >> 3; block < blocks; block++) {
+                    int tile_x0 = object.x + (block << 3);
+
+                    if (tile_x0 >= x_max) {
+                        break;
+                    }
+
+                    // h-flip mirrors the order of the tiles and the pixels within each tile
+                    int block_x = object.h_flip ? (blocks - block - 1) : block;
+                    const u8* row = getTileRow(block_x, tex_y >> 3, tex_y & 7);
+
+                    int first = std::max(x_min - tile_x0, 0);
+                    int last  = std::min(x_max - tile_x0, 8);
+
+                    if (object.h_flip) {
+                        for (int i = first; i < last; i++) {
+                            int index = row[7 - i];
+                            if (index != 0) plot(tile_x0 + i, readPaletteEntry(palette, index));
+                        }
+                    } else {
+                        for (int i = first; i < last; i++) {
+                            int index = row[i];
+                            if (index != 0) plot(tile_x0 + i, readPaletteEntry(palette, index));
+                        }
+                    }
+                }
+                return;
             }
 
-            // half the width and height of OBJ screen area
-            int half_width  = rect_width  >> 1;
-            int half_height = rect_height >> 1;
+            // rot/scale OBJs: step the 8.8 fixed point texture coordinates by PA/PC per pixel
+            const s16* parameters = m_oam_cache.getParameters(object.group);
 
-            int line  = regs.vcount;
-            int min_y = y - half_height;
-            int max_y = y + half_height;
+            s32 pa = parameters[0];
+            s32 pb = parameters[1];
+            s32 pc = parameters[2];
+            s32 pd = parameters[3];
 
-            if (line >= min_y && line < max_y) {
-                int rect_y = line - y;
+            int rect_width  = object.double_size ? (width  << 1) : width;
+            int rect_height = object.double_size ? (height << 1) : height;
 
-                int number  = attribute2 & 0x3FF;
-                int palette = (attribute2 >> 12) + 16;
-                bool h_flip = !affine && (attribute1 & (1 << 12));
-                bool v_flip = !affine && (attribute1 & (1 << 13));
-                bool is_256 = attribute0 & (1 << 13);
+            // center of the OBJ screen area
+            int x = object.x + (rect_width  >> 1);
+            int y = object.y + (rect_height >> 1);
 
-                if (is_256) number >>= 1;
+            int half_width = rect_width >> 1;
+            int rect_y     = line - y;
+            int rect_x_min = std::max(-half_width, -x);
+            int rect_x_max = std::min( half_width, 240 - x);
 
-                for (int rect_x = -half_width; rect_x < half_width; rect_x++) {
+            // texture coordinates relative to the top-left of the OBJ
+            s32 tex_x = pa * rect_x_min + pb * rect_y + ((width  >> 1) << 8);
+            s32 tex_y = pc * rect_x_min + pd * rect_y + ((height >> 1) << 8);
 
-                    // get pixel eccetera...
-                    int screen_x = x + rect_x;
+            for (int rect_x = rect_x_min; rect_x < rect_x_max; rect_x++, tex_x += pa, tex_y += pc) {
+                int tx = tex_x >> 8;
+                int ty = tex_y >> 8;
 
-                    if (screen_x >= 0 && screen_x < 240) {
-                        // texture coordinates
-                        int tex_x = ((pa * rect_x + pb * rect_y) >> 8) + (width  >> 1);
-                        int tex_y = ((pc * rect_x + pd * rect_y) >> 8) + (height >> 1);
+                // are the coordinates inside the valid boundaries?
+                if (static_cast<u32>(tx) >= static_cast<u32>(width) ||
+                    static_cast<u32>(ty) >= static_cast<u32>(height)) {
+                    continue;
+                }
 
-                        // are the coordinates inside the valid boundaries?
-                        if (tex_x >= width || tex_y >= height ||
-                            tex_x < 0      || tex_y < 0     ) { continue; }
+                int index = getTileRow(tx >> 3, ty >> 3, ty & 7)[tx & 7];
 
-                        if (h_flip) {
-                            tex_x = width - tex_x - 1;
-                        }
+                if (index != 0) {
+                    plot(x + rect_x, readPaletteEntry(palette, index));
+                }
+            }
+        });
+    }
 
-                        if (v_flip) {
-                            tex_y = height - tex_y - 1;
-                        }
+    auto PPU::getCachedObject(int index, const OAMCache::Object& object) -> const u16* {
+        const u32 tile_base = 0x10000;
 
-                        int tile_x  = tex_x  & 7;
-                        int tile_y  = tex_y  & 7;
-                        int block_x = tex_x >> 3;
-                        int block_y = tex_y >> 3;
+        const int  width   = object.width;
+        const int  height  = object.height;
+        const bool is_256  = object.is_256;
+        const bool one_dimensional = regs.control.one_dimensional;
 
-                        int tile_num = number;
+        const int row_stride = one_dimensional ? (width >> 3) : (is_256 ? 16 : 32);
 
-                        if (regs.control.one_dimensional) {
-                            tile_num += block_y * (width >> 3);
-                        } else {
-                            tile_num += block_y << (is_256? 4 : 5);
-                        }
+        auto& entry = m_obj_cache.get(index,
+            ObjectCache::makeKey(object.number, is_256 ? 0 : object.palette, width, height,
+                                 is_256, object.h_flip, object.v_flip, one_dimensional),
+            width, height
+        );
 
-                        tile_num += block_x;
+        // VRAM blocks spanned by the tiles of the OBJ
+        const int tile_shift = is_256 ? 6 : 5;
+        const u32 first      = tile_base + (object.number << tile_shift);
+        const u32 last       = first + ((((height >> 3) - 1) * row_stride + (width >> 3)) << tile_shift) - 1;
 
-                        u16 pixel;
+        u32 vram_version = 0;
 
-                        if (is_256) {
-                            pixel = getTilePixel8BPP(tile_base, 16     , tile_num, tile_x, tile_y);
-                        } else {
-                            pixel = getTilePixel4BPP(tile_base, palette, tile_num, tile_x, tile_y);
-                        }
+        for (u32 block = first >> 11; block <= (last >> 11); block++) {
+            vram_version += m_tile_cache.getBlockVersion(block);
+        }
 
-                        auto& p = m_obj_layer[screen_x];
-
-                        // second condition seems counter-intuitive but 0 = highest, 3 = lowest priority
-                        if (pixel != COLOR_TRANSPARENT) {
-                            if (mode == OBJ_WINDOW) {
-                                p.window = true;
-                            } else if (prio <= p.prio) {
-                                p.prio   = prio;
-                                p.pixel  = pixel;
-                                p.alpha  = mode == OBJ_SEMI;
-                                if (p.alpha) {
-                                    line_has_alpha_objs = true;
-                                }
-                            }
-                        }
-                    }
+        u32 palette_version = is_256 ? m_palette_version[1] : m_palette_bank_version[object.palette];
+
+        if (entry.vram_version == vram_version && entry.palette_version == palette_version) {
+            return entry.pixels;
+        }
+
+        const int palette = is_256 ? 16 : object.palette;
+
+        for (int y = 0; y < height; y++) {
+            int tex_y = object.v_flip ? (height - y - 1) : y;
+            u16* dst  = &entry.pixels[y * width];
+
+            for (int block_x = 0; block_x < (width >> 3); block_x++) {
+                int tile_num = object.number + (tex_y >> 3) * row_stride + block_x;
+                const u8* row;
+
+                if (is_256) {
+                    row = m_tile_cache.getRow8BPP(tile_base + (tile_num << 6), tex_y & 7);
+                } else {
+                    row = m_tile_cache.getRow4BPP(tile_base + (tile_num << 5), tex_y & 7);
                 }
-            }
 
-            offset -= 8;
+                for (int i = 0; i < 8; i++) {
+                    int tex_x = (block_x << 3) + i;
+                    int pixel = row[i];
+
+                    dst[object.h_flip ? (width - tex_x - 1) : tex_x] =
+                        (pixel == 0) ? COLOR_TRANSPARENT : readPaletteEntry(palette, pixel);
+                }
+            }
         }
+
+        entry.vram_version    = vram_version;
+        entry.palette_version = palette_version;
+
+        return entry.pixels;
     }
 }
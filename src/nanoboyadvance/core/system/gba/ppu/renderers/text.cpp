@@ -17,83 +17,219 @@
   * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
   */
 
+#include <cstring>
+#include <algorithm>
 #include "../ppu.hpp"
 #include "util/likely.hpp"
 
 namespace Core {
 
+    auto PPU::getMapRow(int id, int row) -> const MapRow& {
+        const auto& bg = regs.bgcnt[id];
+        auto& map_row  = m_map_row[id];
+
+        // 256 pixel high maps repeat every 32 rows
+        row &= (bg.screen_size & 2) ? 63 : 31;
+
+        const int width = (bg.screen_size & 1) ? 64 : 32;
+
+        // screen blocks holding the row: one per 32 columns
+        int block = bg.map_block + ((row >> 5) << (bg.screen_size & 1));
+
+        if (map_row.valid &&
+            map_row.row          == row            &&
+            map_row.map_block    == bg.map_block   &&
+            map_row.tile_block   == bg.tile_block  &&
+            map_row.screen_size  == bg.screen_size &&
+            map_row.full_palette == bg.full_palette &&
+            map_row.version[0]   == m_tile_cache.getBlockVersion(map_row.block[0]) &&
+            map_row.version[1]   == m_tile_cache.getBlockVersion(map_row.block[1])) {
+            return map_row;
+        }
+
+        map_row.valid        = true;
+        map_row.width        = width;
+        map_row.row          = row;
+        map_row.map_block    = bg.map_block;
+        map_row.tile_block   = bg.tile_block;
+        map_row.screen_size  = bg.screen_size;
+        map_row.full_palette = bg.full_palette;
+        map_row.block[0]     = block;
+        map_row.block[1]     = block + (width >> 6);
+        map_row.version[0]   = m_tile_cache.getBlockVersion(map_row.block[0]);
+        map_row.version[1]   = m_tile_cache.getBlockVersion(map_row.block[1]);
+
+        const u32 tile_block = bg.tile_block << 14;
+
+        for (int column = 0; column < width; column++) {
+            auto& entry = map_row.entries[column];
+
+            u32 offset = ((block + (column >> 5)) << 11) + ((row & 0x1F) << 6) + ((column & 0x1F) << 1);
+            u16 encoder = (m_vram[offset + 1] << 8) | m_vram[offset];
+
+            const int number = encoder & 0x3FF;
+
+            entry.encoder = encoder;
+            entry.h_flip  = encoder & (1 << 10);
+            entry.v_flip  = encoder & (1 << 11);
+
+            if (bg.full_palette) {
+                entry.address = tile_block + (number << 6);
+                entry.palette = 0;
+            } else {
+                entry.address = tile_block + (number << 5);
+                entry.palette = encoder >> 12;
+            }
+        }
+
+        return map_row;
+    }
+
     void PPU::renderTextBG(int id) {
+        if (m_layer_cache_enable && m_layer_cache[id].isActive()) {
+            renderTextBGCached(id);
+            return;
+        }
+
         const auto& bg = regs.bgcnt[id];
 
-        u16* buffer    = m_buffer[id];
-        u32 tile_block = bg.tile_block << 14;
+        u16* buffer = m_buffer[id];
 
-        u32 tile_buffer[8];
+        u16 tile_buffer[8];
         int last_encoder = -1;
 
         // scrolled scanline
-        const int line = regs.vcount + regs.bgvofs[id];
-
-        // vertical position data
-        const int row      = line >> 3;
-        const int tile_y   = line &  7;
-        const int screen_y = (row >> 5) & 1;
+        const int line   = regs.vcount + regs.bgvofs[id];
+        const int tile_y = line & 7;
 
-        // points to the start of the row's tile map information
-        const u32 base_offset = (bg.map_block << 11) + ((row & 0x1F) << 6);
+        const auto& map_row = getMapRow(id, line >> 3);
 
         // current pixel being drawn, current map column
         int draw_x = -(regs.bghofs[id]  & 7);
         int column =   regs.bghofs[id] >> 3;
 
-        while (draw_x < 240) {
-            int screen_x = (column >> 5) & 1;
-
-            int offset = base_offset + ((column++ & 0x1F) << 1);
+        const int column_mask = map_row.width - 1;
 
-            switch (bg.screen_size) {
-                case 1: offset += screen_x << 11; break;
-                case 2: offset += screen_y << 11; break;
-                case 3: offset += (screen_x << 11) + (screen_y << 12); break;
-            }
-
-            u16 encoder = (m_vram[offset + 1] << 8) | m_vram[offset];
+        while (draw_x < 240) {
+            const auto& entry = map_row.entries[column++ & column_mask];
 
             // only decode a new tile if neccessary
-            if (encoder != last_encoder) {
-                // tile number and palette
-                const int number  = encoder & 0x3FF;
-                const int palette = encoder >> 12;
+            if (entry.encoder != last_encoder) {
+                const int final_y = entry.v_flip ? (tile_y ^ 7) : tile_y;
+                const u8* data;
 
-                // flipping information
-                const bool h_flip = encoder & (1 << 10);
-                const bool v_flip = encoder & (1 << 11);
+                if (UNLIKELY(bg.full_palette)) {
+                    data = m_tile_cache.getRow8BPP(entry.address, final_y);
+                } else {
+                    data = m_tile_cache.getRow4BPP(entry.address, final_y);
+                }
 
-                const int final_y = v_flip ? (tile_y ^ 7) : tile_y;
+                const u16* palette = &m_palette[entry.palette << 4];
 
-                // decode the determined tile into our buffer
-                if (UNLIKELY(bg.full_palette)) {
-                    drawTileLine8BPP(tile_buffer, tile_block, number, final_y, h_flip);
+                if (entry.h_flip) {
+                    for (int x = 0; x < 8; x++) {
+                        int pixel = data[7 - x];
+                        tile_buffer[x] = (pixel == 0) ? COLOR_TRANSPARENT : palette[pixel];
+                    }
                 } else {
-                    drawTileLine4BPP(tile_buffer, tile_block, palette, number, final_y, h_flip);
+                    for (int x = 0; x < 8; x++) {
+                        int pixel = data[x];
+                        tile_buffer[x] = (pixel == 0) ? COLOR_TRANSPARENT : palette[pixel];
+                    }
                 }
 
-                last_encoder = encoder;
+                last_encoder = entry.encoder;
             }
 
             if (LIKELY(draw_x >= 0 && draw_x <= 232)) {
-                for (int x = 0; x < 8; x++) {
-                    buffer[draw_x++] = tile_buffer[x];
-                }
+                memcpy(&buffer[draw_x], tile_buffer, sizeof(tile_buffer));
+                draw_x += 8;
             } else {
                 for (int x = 0; x < 8; x++) {
-                    if (draw_x < 0 || draw_x >= 240) {
-                        draw_x++;
-                        continue;
+                    if (draw_x >= 0 && draw_x < 240) {
+                        buffer[draw_x] = tile_buffer[x];
                     }
-                    buffer[draw_x++] = tile_buffer[x];
+                    draw_x++;
                 }
             }
         }
     }
+
+    void PPU::renderTextBGCached(int id) {
+        const auto& bg = regs.bgcnt[id];
+        auto& cache    = m_layer_cache[id];
+
+        cache.configure(
+            (bg.screen_size & 1) ? 512 : 256,
+            (bg.screen_size & 2) ? 512 : 256,
+            bg.map_block | (bg.tile_block << 5) | (bg.screen_size << 7) | (bg.full_palette << 9)
+        );
+
+        const int width  = cache.getWidth();
+        const int y      = (regs.vcount + regs.bgvofs[id]) & (cache.getHeight() - 1);
+        const int row    = y >> 3;
+
+        const u32 vram_version = m_tile_cache.getVersion();
+
+        // redraw the cells of this map row that went stale
+        if (!cache.isRowCurrent(row, vram_version, m_palette_version[0])) {
+            const auto& map_row = getMapRow(id, row);
+
+            for (int column = 0; column < (width >> 3); column++) {
+                const auto& entry = map_row.entries[column];
+                auto& cell = cache.getCell(row, column);
+
+                u32 tile_version    = m_tile_cache.getBlockVersion(entry.address >> 11);
+                u32 palette_version = bg.full_palette ? m_palette_version[0] : m_palette_bank_version[entry.palette];
+
+                if (cell.encoder         != entry.encoder ||
+                    cell.tile_version    != tile_version  ||
+                    cell.palette_version != palette_version) {
+                    drawLayerCell(id, row, column, entry);
+
+                    cell.encoder         = entry.encoder;
+                    cell.tile_version    = tile_version;
+                    cell.palette_version = palette_version;
+                    cache.countRedraw();
+                }
+            }
+            cache.setRowCurrent(row, vram_version, m_palette_version[0]);
+        }
+
+        // wrap-aware copy of the visible part of the line
+        const u16* src = cache.getLine(y);
+        const int  x   = regs.bghofs[id] & (width - 1);
+        const int  n   = std::min(240, width - x);
+
+        memcpy(m_buffer[id], &src[x], n * sizeof(u16));
+
+        if (n < 240) {
+            memcpy(&m_buffer[id][n], src, (240 - n) * sizeof(u16));
+        }
+    }
+
+    void PPU::drawLayerCell(int id, int row, int column, const MapRow::Entry& entry) {
+        const bool full_palette = regs.bgcnt[id].full_palette;
+        const u16* palette = &m_palette[entry.palette << 4];
+
+        auto& cache = m_layer_cache[id];
+
+        for (int tile_y = 0; tile_y < 8; tile_y++) {
+            const int final_y = entry.v_flip ? (tile_y ^ 7) : tile_y;
+            const u8* data;
+
+            if (full_palette) {
+                data = m_tile_cache.getRow8BPP(entry.address, final_y);
+            } else {
+                data = m_tile_cache.getRow4BPP(entry.address, final_y);
+            }
+
+            u16* dst = cache.getLine((row << 3) + tile_y) + (column << 3);
+
+            for (int x = 0; x < 8; x++) {
+                int pixel = data[entry.h_flip ? (7 - x) : x];
+                dst[x] = (pixel == 0) ? COLOR_TRANSPARENT : palette[pixel];
+            }
+        }
+    }
 }
@@ -0,0 +1,177 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include "renderthread.hpp"
+
+#ifdef PPU_RENDER_THREAD
+
+#include <cstring>
+
+namespace Core {
+
+    RenderThread::RenderThread(Config* config, u8* pram, u8* oam, u8* vram) :
+            m_config(config),
+            m_worker_config(makeWorkerConfig(*config)),
+            m_live { pram, vram, oam },
+            m_ppu(&m_worker_config, m_pal, m_oam, m_vram)
+    {
+        resync();
+
+        m_thread = std::thread(&RenderThread::run, this);
+    }
+
+    RenderThread::~RenderThread() {
+        push({ Command::Quit, 0, 0, 0, 0, 0 });
+        m_thread.join();
+    }
+
+    void RenderThread::resync() {
+        waitIdle();
+
+        memcpy(m_pal,  m_live[static_cast<int>(PPU::Region::Palette)], sizeof(m_pal));
+        memcpy(m_vram, m_live[static_cast<int>(PPU::Region::VRAM)],    sizeof(m_vram));
+        memcpy(m_oam,  m_live[static_cast<int>(PPU::Region::OAM)],     sizeof(m_oam));
+
+        m_ppu.reset();
+    }
+
+    void RenderThread::reloadConfig() {
+        waitIdle();
+        updateWorkerConfig();
+    }
+
+    auto RenderThread::makeWorkerConfig(const Config& config) -> Config {
+        Config worker = config;
+
+        // the emulated PPU does the frameskipping, lines are rendered as they arrive
+        worker.frameskip          = 0;
+        worker.deferred_rendering = false;
+        worker.render_thread      = false;
+
+        return worker;
+    }
+
+    void RenderThread::updateWorkerConfig() {
+        m_worker_config = makeWorkerConfig(*m_config);
+        m_ppu.reloadConfig();
+    }
+
+    void RenderThread::pushLine(const PPU::IO& regs) {
+        m_line_regs[regs.vcount] = regs;
+        push({ Command::Line, 0, 0, static_cast<u8>(regs.vcount), 0, 0 });
+    }
+
+    void RenderThread::pushWrite(PPU::Region region, u32 address, int size) {
+        Message message { Command::Write, static_cast<u8>(region), static_cast<u8>(size), 0, address, 0 };
+
+        memcpy(&message.value, m_live[message.region] + address, size);
+        push(message);
+    }
+
+    void RenderThread::finishFrame() {
+        push({ Command::FinishFrame, 0, 0, 0, 0, 0 });
+        waitIdle();
+    }
+
+    template <typename F>
+    void RenderThread::block(Waiter& waiter, F&& ready) {
+        for (int i = 0; i < s_spin_count; i++) {
+            if (ready()) {
+                return;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // Pairs with the fence in notify(): either ready() sees the other
+        // thread's change or the other thread sees waiting and wakes us.
+        waiter.waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        waiter.wake.wait(lock, ready);
+        waiter.waiting.store(false, std::memory_order_relaxed);
+    }
+
+    void RenderThread::notify(Waiter& waiter) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiter.waiting.load(std::memory_order_relaxed)) {
+            // taking the lock makes sure the waiter is asleep or has not checked yet
+            std::lock_guard<std::mutex> lock(m_mutex);
+            waiter.wake.notify_one();
+        }
+    }
+
+    void RenderThread::push(const Message& message) {
+        // the worker is at most a full queue behind
+        if (!m_queue.push(message)) {
+            block(m_emulator, [&] { return m_queue.push(message); });
+        }
+        m_sent.store(m_sent.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        notify(m_worker);
+    }
+
+    void RenderThread::waitIdle() {
+        u32 sent = m_sent.load(std::memory_order_relaxed);
+
+        block(m_emulator, [&] { return m_done.load(std::memory_order_acquire) == sent; });
+    }
+
+    void RenderThread::run() {
+        Message message;
+
+        while (true) {
+            if (!m_queue.pop(message)) {
+                block(m_worker, [this] { return !m_queue.empty(); });
+                continue;
+            }
+
+            switch (message.command) {
+                case Command::Line: {
+                    m_ppu.regs = m_line_regs[message.line];
+                    m_ppu.drawLine();
+                    break;
+                }
+                case Command::Write: {
+                    auto region = static_cast<PPU::Region>(message.region);
+
+                    memcpy(m_ppu.getRegionPointer(region) + message.address, &message.value, message.size);
+
+                    switch (region) {
+                        case PPU::Region::Palette: m_ppu.onPaletteWrite(message.address, message.size); break;
+                        case PPU::Region::VRAM:    m_ppu.onVRAMWrite   (message.address, message.size); break;
+                        case PPU::Region::OAM:     m_ppu.onOAMWrite    (message.address, message.size); break;
+                    }
+                    break;
+                }
+                case Command::FinishFrame: {
+                    m_ppu.finishFrame();
+                    break;
+                }
+                case Command::Quit: {
+                    return;
+                }
+            }
+
+            m_done.store(m_done.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            notify(m_emulator);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include "ppu.hpp"
+
+#ifdef PPU_RENDER_THREAD
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "util/spscqueue.hpp"
+
+namespace Core {
+
+    // Renders on a second core while the CPU keeps running (see Config::render_thread).
+    //
+    // The emulated PPU only forwards each visible line's registers and every
+    // palette, VRAM and OAM write through a lock-free queue. The worker applies
+    // the writes to its own copy of PPU memory and renders each line with a
+    // private PPU instance, so it always sees memory exactly as the line did.
+    // A full queue stalls the CPU (bounded lag), VBlank waits for the worker.
+    // Either side spins briefly and then sleeps until the other one wakes it.
+    class RenderThread {
+    public:
+        RenderThread(Config* config, u8* pram, u8* oam, u8* vram);
+       ~RenderThread();
+
+        // Waits for all queued work, then copies PPU memory and resets the worker's PPU.
+        void resync();
+
+        // Waits for all queued work, then applies the current config.
+        void reloadConfig();
+
+        void pushLine(const PPU::IO& regs);
+        void pushWrite(PPU::Region region, u32 address, int size);
+
+        // Ends the frame and waits until the worker has caught up.
+        void finishFrame();
+
+        // Waits until the worker has processed everything queued so far.
+        void waitIdle();
+
+        // The PPU that renders, only to be used while the worker is idle.
+        auto getPPU() -> PPU& {
+            return m_ppu;
+        }
+
+    private:
+        enum class Command : u8 {
+            Line,
+            Write,
+            FinishFrame,
+            Quit
+        };
+
+        struct Message {
+            Command command;
+            u8      region;
+            u8      size;
+            u8      line;
+            u32     address;
+            u32     value;
+        };
+
+        static constexpr std::size_t s_queue_size = 8192;
+        static constexpr int s_spin_count = 1024; // polls before going to sleep
+
+        // A thread sleeping on wake until its condition holds, see block() and notify().
+        struct Waiter {
+            std::atomic<bool> waiting { false };
+            std::condition_variable wake;
+        };
+
+        Config* m_config;
+        Config  m_worker_config;
+
+        // PPU memory as seen by the line the worker is on
+        u8* m_live[3];
+        u8  m_pal [0x00400];
+        u8  m_oam [0x00400];
+        u8  m_vram[0x18000];
+
+        PPU m_ppu;
+
+        // registers of each line, a slot is reused only after the next VBlank sync
+        PPU::IO m_line_regs[160];
+
+        Util::SPSCQueue<Message, s_queue_size> m_queue;
+
+        std::atomic<u32> m_sent { 0 };
+        std::atomic<u32> m_done { 0 };
+
+        std::mutex m_mutex;
+        Waiter m_worker;   // for messages
+        Waiter m_emulator; // for queue space or the worker to go idle
+
+        std::thread m_thread;
+
+        static auto makeWorkerConfig(const Config& config) -> Config;
+
+        template <typename F>
+        void block(Waiter& waiter, F&& ready);
+        void notify(Waiter& waiter);
+
+        void push(const Message& message);
+        void updateWorkerConfig();
+        void run();
+    };
+}
+
+#endif
@@ -0,0 +1,176 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include "util/integer.hpp"
+
+// PPU_NO_SIMD forces the scalar fallback, e.g. to compare both paths.
+#if defined(PPU_NO_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define PPU_SIMD
+    #define PPU_SIMD_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define PPU_SIMD
+    #define PPU_SIMD_SSE2
+#endif
+
+#ifdef PPU_SIMD
+
+// Minimal vector layer for the compositor: eight 16-bit lanes.
+// NEON on the V5 (Cortex-A9), SSE2 on desktop builds.
+// Lane values must stay below 0x8000 for min() since SSE2 only has a signed 16-bit min.
+namespace Core {
+namespace SIMD {
+
+    static constexpr int s_lanes = 8;
+
+#if defined(PPU_SIMD_NEON)
+
+    using u16x8 = uint16x8_t;
+
+    inline u16x8 load(const u16* src) { return vld1q_u16(src); }
+    inline u16x8 loadU8(const u8* src) { return vmovl_u8(vld1_u8(src)); }
+    inline void  store(u16* dst, u16x8 a) { vst1q_u16(dst, a); }
+    inline u16x8 splat(u16 value) { return vdupq_n_u16(value); }
+
+    inline u16x8 bitAnd(u16x8 a, u16x8 b) { return vandq_u16(a, b); }
+    inline u16x8 bitOr (u16x8 a, u16x8 b) { return vorrq_u16(a, b); }
+    inline u16x8 bitAndNot(u16x8 a, u16x8 b) { return vbicq_u16(a, b); } // a & ~b
+
+    inline u16x8 equal  (u16x8 a, u16x8 b) { return vceqq_u16(a, b); }
+    inline u16x8 nonZero(u16x8 a) { return vtstq_u16(a, a); }
+    inline u16x8 select (u16x8 mask, u16x8 a, u16x8 b) { return vbslq_u16(mask, a, b); }
+
+    inline u16x8 add(u16x8 a, u16x8 b) { return vaddq_u16(a, b); }
+    inline u16x8 sub(u16x8 a, u16x8 b) { return vsubq_u16(a, b); }
+    inline u16x8 mul(u16x8 a, u16x8 b) { return vmulq_u16(a, b); }
+    inline u16x8 min(u16x8 a, u16x8 b) { return vminq_u16(a, b); }
+
+    template <int n> inline u16x8 shiftLeft (u16x8 a) { return vshlq_n_u16(a, n); }
+    template <int n> inline u16x8 shiftRight(u16x8 a) { return vshrq_n_u16(a, n); }
+
+    inline uint32x4_t toARGB(uint32x4_t c, uint32x4_t alpha) {
+        uint32x4_t r = vshlq_n_u32(vandq_u32(c, vdupq_n_u32(0x001F)), 19);
+        uint32x4_t g = vshlq_n_u32(vandq_u32(c, vdupq_n_u32(0x03E0)), 6);
+        uint32x4_t b = vshrq_n_u32(vandq_u32(c, vdupq_n_u32(0x7C00)), 7);
+
+        return vorrq_u32(vorrq_u32(r, g), vorrq_u32(b, alpha));
+    }
+
+    // Converts eight RGB555 colors to 0x??RRGGBB, the top byte is taken from alpha.
+    inline void storeARGB(u32* dst, u16x8 a, u32 alpha) {
+        uint32x4_t alpha4 = vdupq_n_u32(alpha);
+
+        vst1q_u32(dst + 0, toARGB(vmovl_u16(vget_low_u16 (a)), alpha4));
+        vst1q_u32(dst + 4, toARGB(vmovl_u16(vget_high_u16(a)), alpha4));
+    }
+
+#elif defined(PPU_SIMD_SSE2)
+
+    using u16x8 = __m128i;
+
+    inline u16x8 load(const u16* src) { return _mm_loadu_si128((const __m128i*)src); }
+    inline u16x8 loadU8(const u8* src) { return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)src), _mm_setzero_si128()); }
+    inline void  store(u16* dst, u16x8 a) { _mm_storeu_si128((__m128i*)dst, a); }
+    inline u16x8 splat(u16 value) { return _mm_set1_epi16((short)value); }
+
+    inline u16x8 bitAnd(u16x8 a, u16x8 b) { return _mm_and_si128(a, b); }
+    inline u16x8 bitOr (u16x8 a, u16x8 b) { return _mm_or_si128 (a, b); }
+    inline u16x8 bitAndNot(u16x8 a, u16x8 b) { return _mm_andnot_si128(b, a); } // a & ~b
+
+    inline u16x8 equal  (u16x8 a, u16x8 b) { return _mm_cmpeq_epi16(a, b); }
+    inline u16x8 nonZero(u16x8 a) { return _mm_xor_si128(_mm_cmpeq_epi16(a, _mm_setzero_si128()), _mm_set1_epi32(-1)); }
+    inline u16x8 select (u16x8 mask, u16x8 a, u16x8 b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+    inline u16x8 add(u16x8 a, u16x8 b) { return _mm_add_epi16  (a, b); }
+    inline u16x8 sub(u16x8 a, u16x8 b) { return _mm_sub_epi16  (a, b); }
+    inline u16x8 mul(u16x8 a, u16x8 b) { return _mm_mullo_epi16(a, b); }
+    inline u16x8 min(u16x8 a, u16x8 b) { return _mm_min_epi16  (a, b); }
+
+    template <int n> inline u16x8 shiftLeft (u16x8 a) { return _mm_slli_epi16(a, n); }
+    template <int n> inline u16x8 shiftRight(u16x8 a) { return _mm_srli_epi16(a, n); }
+
+    inline __m128i toARGB(__m128i c, __m128i alpha) {
+        __m128i r = _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x001F)), 19);
+        __m128i g = _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x03E0)), 6);
+        __m128i b = _mm_srli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x7C00)), 7);
+
+        return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, alpha));
+    }
+
+    // Converts eight RGB555 colors to 0x??RRGGBB, the top byte is taken from alpha.
+    inline void storeARGB(u32* dst, u16x8 a, u32 alpha) {
+        __m128i zero   = _mm_setzero_si128();
+        __m128i alpha4 = _mm_set1_epi32((int)alpha);
+
+        _mm_storeu_si128((__m128i*)(dst + 0), toARGB(_mm_unpacklo_epi16(a, zero), alpha4));
+        _mm_storeu_si128((__m128i*)(dst + 4), toARGB(_mm_unpackhi_epi16(a, zero), alpha4));
+    }
+
+#endif
+
+    // Alpha blend of two RGB555 colors: min(31, (a * eva + b * evb) >> 4) per channel.
+    inline u16x8 blend(u16x8 a, u16x8 b, u16x8 eva, u16x8 evb) {
+        u16x8 mask   = splat(0x1F);
+        u16x8 limit  = splat(31);
+        u16x8 result = min(limit, shiftRight<4>(add(mul(bitAnd(a, mask), eva), mul(bitAnd(b, mask), evb))));
+
+        a = shiftRight<5>(a);
+        b = shiftRight<5>(b);
+        result = bitOr(result, shiftLeft<5>(min(limit, shiftRight<4>(add(mul(bitAnd(a, mask), eva), mul(bitAnd(b, mask), evb))))));
+
+        a = shiftRight<5>(a);
+        b = shiftRight<5>(b);
+        result = bitOr(result, shiftLeft<10>(min(limit, shiftRight<4>(add(mul(bitAnd(a, mask), eva), mul(bitAnd(b, mask), evb))))));
+
+        return result;
+    }
+
+    // Brightness increase: c + (((31 - c) * evy) >> 4) per channel.
+    inline u16x8 brighten(u16x8 a, u16x8 evy) {
+        u16x8 mask = splat(0x1F);
+        u16x8 r = bitAnd(a, mask);
+        u16x8 g = bitAnd(shiftRight<5> (a), mask);
+        u16x8 b = bitAnd(shiftRight<10>(a), mask);
+
+        r = add(r, shiftRight<4>(mul(sub(mask, r), evy)));
+        g = add(g, shiftRight<4>(mul(sub(mask, g), evy)));
+        b = add(b, shiftRight<4>(mul(sub(mask, b), evy)));
+
+        return bitOr(r, bitOr(shiftLeft<5>(g), shiftLeft<10>(b)));
+    }
+
+    // Brightness decrease: (c * (16 - evy)) >> 4 per channel.
+    inline u16x8 darken(u16x8 a, u16x8 evy) {
+        u16x8 factor = sub(splat(16), evy);
+        u16x8 mask   = splat(0x1F);
+        u16x8 result = shiftRight<4>(mul(bitAnd(a, mask), factor));
+
+        result = bitOr(result, shiftLeft<5> (shiftRight<4>(mul(bitAnd(shiftRight<5> (a), mask), factor))));
+        result = bitOr(result, shiftLeft<10>(shiftRight<4>(mul(bitAnd(shiftRight<10>(a), mask), factor))));
+
+        return result;
+    }
+}
+}
+
+#endif
@@ -0,0 +1,121 @@
+/**
+  * Copyright (C) 2017 flerovium^-^ (Frederic Meyer)
+  *
+  * This file is part of NanoboyAdvance.
+  *
+  * NanoboyAdvance is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * NanoboyAdvance is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with NanoboyAdvance. If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <cstring>
+#include "util/integer.hpp"
+
+namespace Core {
+
+    // Keeps every 4BPP tile in VRAM in an unpacked form with one palette
+    // index (0 = transparent) per byte. VRAM writes only mark tiles as dirty,
+    // a tile is decoded the first time it is fetched after that.
+    // 8BPP tiles already have that layout and are read from VRAM directly.
+    //
+    // H-flipped tiles are read back-to-front by the renderers instead of
+    // caching a second orientation, which would double the cache footprint.
+    //
+    // It also counts the writes to each 2KB block (the size of one screen
+    // block), so that caches built from tile map data can tell if they are stale.
+    class TileCache {
+    public:
+        static constexpr u32 s_vram_size  = 0x18000;
+        static constexpr int s_tiles_4bpp = s_vram_size >> 5;
+        static constexpr int s_blocks     = s_vram_size >> 11;
+
+        TileCache(u8* vram) : m_vram(vram) {
+            invalidate();
+        }
+
+        void invalidate() {
+            memset(m_dirty, 1, sizeof(m_dirty));
+
+            for (int i = 0; i <= s_blocks; i++) {
+                m_block_version[i]++;
+            }
+            m_version++;
+        }
+
+        void markDirty(u32 address, int size) {
+            m_dirty[ address             >> 5] = true;
+            m_dirty[(address + size - 1) >> 5] = true;
+
+            m_block_version[ address             >> 11]++;
+            m_block_version[(address + size - 1) >> 11]++;
+            m_version++;
+        }
+
+        // Returns a counter that changes whenever the given 2KB block is written.
+        // Blocks past the end of VRAM share the last counter.
+        auto getBlockVersion(int block) const -> u32 {
+            return m_block_version[block < s_blocks ? block : s_blocks];
+        }
+
+        // Returns a counter that changes on any VRAM write.
+        auto getVersion() const -> u32 {
+            return m_version;
+        }
+
+        // Returns the eight palette indices of row y of the 4BPP tile at address.
+        auto getRow4BPP(u32 address, int y) -> const u8* {
+            u32 tile = address >> 5;
+
+            if (tile >= s_tiles_4bpp) {
+                return s_blank_row;
+            }
+            if (m_dirty[tile]) {
+                decode(tile);
+            }
+            return &m_data[tile][y << 3];
+        }
+
+        // Returns the eight palette indices of row y of the 8BPP tile at address.
+        auto getRow8BPP(u32 address, int y) -> const u8* {
+            if (address >= s_vram_size) {
+                return s_blank_row;
+            }
+            return &m_vram[address + (y << 3)];
+        }
+
+    private:
+        static constexpr u8 s_blank_row[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        u8* m_vram;
+
+        // one spare flag for unaligned writes at the very end of VRAM
+        bool m_dirty[s_tiles_4bpp + 1];
+        u8   m_data [s_tiles_4bpp][64];
+
+        u32 m_block_version[s_blocks + 1] = {};
+        u32 m_version = 0;
+
+        void decode(u32 tile) {
+            u8* src = &m_vram[tile << 5];
+            u8* dst = m_data[tile];
+
+            for (int i = 0; i < 32; i++) {
+                int tuple = *src++;
+                *dst++ = tuple & 15;
+                *dst++ = tuple >> 4;
+            }
+            m_dirty[tile] = false;
+        }
+    };
+}
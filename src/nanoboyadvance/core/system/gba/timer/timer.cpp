@@ -58,8 +58,8 @@ namespace Core {
                     if (control.interrupt) {
                         m_interrupt.request((InterruptType)(INTERRUPT_TIMER_0 << id));
                     }
-                    if (timer.id < 2 && apu.getIO().control.master_enable) {
-                        timerHandleFIFO(id, 1);
+                    if (id < 2 && apu.getIO().control.master_enable) {
+                        m_fifo_overflows[id]++;
                     }
                 }
                 regs.timer[id - 1].overflow = false;
@@ -86,8 +86,8 @@ namespace Core {
                 if (control.interrupt) {
                     m_interrupt.request((InterruptType)(INTERRUPT_TIMER_0 << id));
                 }
-                if (timer.id < 2 && apu.getIO().control.master_enable) {
-                    timerHandleFIFO(id, overflows);
+                if (id < 2 && apu.getIO().control.master_enable) {
+                    m_fifo_overflows[id] += overflows;
                 }
             }
             timer.cycles = available;
@@ -104,21 +104,35 @@ namespace Core {
             if (control.dma[fifo].timer_num != timer_id) {
                 continue;
             }
-            u32  address = fifo_addr[fifo];
+            // the DMA that refills this FIFO, if any
+            int refill = -1;
+
+            for (int dma_id = 1; dma_id <= 2; dma_id++) {
+                auto& dma = regs.dma[dma_id];
+                if (dma.enable && dma.time == DMA_SPECIAL && dma.dst_addr == fifo_addr[fifo]) {
+                    refill = dma_id;
+                    break;
+                }
+            }
+
             for (int time = 0; time < times; time++) {
                 apu.signalFifoTransfer(fifo);
-                if (!apu_io.fifo[fifo].requiresData()) {
-                    continue;
-                }
-                for (int dma_id = 1; dma_id <= 2; dma_id++) {
-                    auto& dma = regs.dma[dma_id];
-                    if (dma.enable && dma.time == DMA_SPECIAL && dma.dst_addr == address) {
-                        dmaTransferFIFO(dma_id);
-                        break;
-                    }
+                if (refill != -1 && apu_io.fifo[fifo].requiresData()) {
+                    dmaTransferFIFO(refill, fifo);
                 }
             }
         }
     }
 
+    void Emulator::timerFlushFIFO() {
+        for (int id = 0; id < 2; id++) {
+            int times = m_fifo_overflows[id];
+
+            if (times != 0) {
+                m_fifo_overflows[id] = 0;
+                timerHandleFIFO(id, times);
+            }
+        }
+    }
+
 }
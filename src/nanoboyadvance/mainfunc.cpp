@@ -1,9 +1,12 @@
 #include <string>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 
 #include "core/system/gba/emulator.hpp"
 #include "util/file.hpp"
 #include "util/ini.hpp"
+#include "util/framepacer.hpp"
 
 #include "version.hpp"
 
@@ -22,16 +25,32 @@ const int y_offset = (LV_VER_RES - g_height)/2;
 
 lv_vdb_t *framebuffer;
 u16* keyinput;
-u32 fbuffer[240 * 160];
 
 Config   g_config;
 Emulator g_emu(&g_config);
 
+// PROS only has a millisecond clock
+FramePacer g_pacer([] { return millis() * 1000; });
+
+// frames go from the emulator task to the presenter task (zeroed as a global)
+TripleBuffer<Frame> g_frames;
+Scaler g_scaler;
+pros::task_t g_presenter;
+
+// controller samples from the input task, read by the game through KEYINPUT
+InputQueue g_input;
+
+// longest stretch the emulator runs before lower priority (robot) tasks get the CPU
+const u32 s_slice_ms = 4;
+u32 g_last_yield;
+
 const std::string g_version_title = "NanoboyAdvance " + std::to_string(VERSION_MAJOR) + "." + std::to_string(VERSION_MINOR);
 
 void setupWindow();
+void runFrameShared();
 void drawFrame();
-void updateInput();
+void presentFrames(void*);
+void pollInput(void*);
 
 int start_emulator() {
     //int scale = 1;
@@ -50,7 +69,11 @@ int start_emulator() {
 
     //if (scale < 1) scale = 1;
 
-    g_config.framebuffer = fbuffer;
+    std::cout << "initializing window" << std::endl;
+    setupWindow();
+
+    // same priority as the emulator, it runs whenever the emulator sleeps or yields
+    g_presenter = task_create(presentFrames, nullptr, TASK_PRIORITY_DEFAULT + 2, TASK_STACK_DEPTH_DEFAULT, "Presenter");
 
     std::cout << "loading bios" << std::endl;
     g_emu.reloadConfig();
@@ -69,56 +92,180 @@ int start_emulator() {
     auto cart = Cartridge::fromFile(rom_path);
 
     g_emu.loadGame(cart);
+    g_emu.setInputProvider(&g_input);
     keyinput = &g_emu.getKeypad();
 
-    std::cout << "initializing window" << std::endl;
-    setupWindow();
+    // short and above the emulator, so samples are taken on time
+    task_create(pollInput, nullptr, TASK_PRIORITY_DEFAULT + 3, TASK_STACK_DEPTH_DEFAULT, "Input");
 
     std::cout << "starting emulation" << std::endl;
 
+    g_last_yield = millis();
+
     while(true){
-        updateInput();
-        g_emu.runFrame();
-        delay(3);
+        g_pacer.beginFrame();
+        runFrameShared();
         drawFrame();
+
+        u32 sleep = g_pacer.endFrame();
+
+        // under load only the drawing is skipped, the game and audio keep their speed
+        if (g_pacer.frameskip() != g_config.frameskip) {
+            g_config.frameskip = g_pacer.frameskip();
+            g_emu.getPPU().setFrameskip(g_config.frameskip);
+        }
+
+        // sleep off the slack, a zero delay still lets the other tasks run
+        delay(sleep / 1000);
+        g_last_yield = millis();
     }
 
     return 0;
 }
 
-void drawFrame(){
-    //nearest neighbor scaling
-    const static int w1 = g_width, h1 = g_height, w2 = LV_HOR_RES, h2 = LV_VER_RES;
-    const int x_ratio = ((w1<<16)/w2) + 1;
-    const int y_ratio = ((h1<<16)/h2) + 1;
-    for(int i = 0; i < h2; ++i){
-        for(int j = 0; j < w2; ++j){
-            int x2 = (j*x_ratio)>>16;
-            int y2 = (i*y_ratio)>>16;
-            framebuffer->buf[(i*w2)+j].full = fbuffer[(y2*w1)+x2];
-            framebuffer->buf[(i*w2)+j].alpha = 0;
+void yieldFor(u32 ms) {
+    u32 start = millis();
+
+    delay(ms);
+    g_last_yield = millis();
+    g_pacer.slept((g_last_yield - start) * 1000);
+}
+
+// Runs a frame in slices, the robot's tasks get the CPU in between and while the game idles.
+void runFrameShared() {
+    using Result = Emulator::RunResult;
+
+    while (true) {
+        auto result = g_emu.runUntil((g_last_yield + s_slice_ms) * 1000);
+
+        if (result == Result::FrameEnded) {
+            return;
+        }
+
+        // waiting for an interrupt, sleep until the emulated time is due
+        u32 wait = 0;
+
+        if (result == Result::Halted) {
+            wait = g_pacer.timeUntil(g_emu.getFrameCycles()) / 1000;
+        }
+
+        if (wait > 0 || millis() - g_last_yield >= s_slice_ms) {
+            yieldFor(std::max<u32>(wait, 1));
         }
     }
+}
+
+void drawFrame(){
+    // the PPU published the frame if it changed, the presenter picks up the latest one
+    task_notify(g_presenter);
+}
+
+void presentFrames(void*) {
+    // versions of the lines on screen, nothing is on screen yet
+    u32 shown[160];
+
+    for (auto& version : shown) {
+        version = ~0u;
+    }
+
+    while (true) {
+        task_notify_take(true, TIMEOUT_MAX);
+
+        if (!g_frames.acquire()) {
+            continue;
+        }
+
+        const auto& frame = g_frames.front();
+        u32* vdb = reinterpret_cast<u32*>(framebuffer->buf);
+
+        // scale and send each run of lines that changed since the frame on screen
+        int line = 0;
 
-    lv_vdb_flush();
+        while (line < 160) {
+            if (frame.version[line] == shown[line]) {
+                line++;
+                continue;
+            }
+
+            int first = line;
+
+            for (; line < 160 && frame.version[line] != shown[line]; line++) {
+                g_scaler.scaleLine(&frame.pixels[line * 240], line, vdb, LV_HOR_RES);
+                shown[line] = frame.version[line];
+            }
+
+            int row_first = g_scaler.rowOf(first);
+            int row_last  = g_scaler.rowOf(line) - 1;
+
+            if (row_last >= row_first) {
+                lv_disp_flush(0, row_first, LV_HOR_RES - 1, row_last, framebuffer->buf + row_first * LV_HOR_RES);
+            }
+        }
+    }
 }
 
 void setupWindow() {
+    static_assert(sizeof(lv_color_t) == sizeof(u32), "PPU output requires a 32-bit LVGL color format");
+
     framebuffer = lv_vdb_get();
+
+    // the letterbox borders are never written by the PPU
+    memset(framebuffer->buf, 0, LV_HOR_RES * LV_VER_RES * sizeof(lv_color_t));
+
+    // the PPU publishes whole frames, the presenter scales them into the VDB
+    g_config.frames                  = &g_frames;
+    g_config.pixel_format            = Config::PixelFormat::XRGB8888;
+    g_scaler.configure(g_width, g_height, LV_HOR_RES, LV_VER_RES, Scaler::Mode::Aspect);
+
+    // up to 512 KB per text BG, turns itself off for layers that change too often
+    g_config.bg_layer_cache          = true;
+    g_config.obj_cache_size          = 256 * 1024;
+
+    // lines that did not change are carried over from the previous frame
+    g_config.skip_unchanged_lines    = true;
+
+    // render each frame in one batch at VBlank, away from the interpreter's working set
+    g_config.deferred_rendering      = true;
+
+    // drop blending and windows for the rest of a frame that takes more than 8 ms to render
+    g_config.clock_us                = [] { return millis() * 1000; };
+    g_config.render_budget           = 8000;
 }
 
-void updateInput(){
+void pollInput(void*) {
     using namespace pros;
-    using namespace Core;
-
-    g_emu.setKeyState(Key::A,       controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_A));
-    g_emu.setKeyState(Key::B,       controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_B));
-    g_emu.setKeyState(Key::Start,   controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_X));
-    g_emu.setKeyState(Key::Select,  controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_Y));
-    g_emu.setKeyState(Key::Right,   controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_RIGHT));
-    g_emu.setKeyState(Key::Left,    controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_LEFT));
-    g_emu.setKeyState(Key::Up,      controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_UP));
-    g_emu.setKeyState(Key::Down,    controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_DOWN));
-    g_emu.setKeyState(Key::R,       controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_R1));
-    g_emu.setKeyState(Key::L,       controller_get_digital(E_CONTROLLER_MASTER, E_CONTROLLER_DIGITAL_L1));
+
+    static const struct {
+        controller_digital_e_t button;
+        Key key;
+    } s_buttons[] = {
+        { E_CONTROLLER_DIGITAL_A,     Key::A      },
+        { E_CONTROLLER_DIGITAL_B,     Key::B      },
+        { E_CONTROLLER_DIGITAL_X,     Key::Start  },
+        { E_CONTROLLER_DIGITAL_Y,     Key::Select },
+        { E_CONTROLLER_DIGITAL_RIGHT, Key::Right  },
+        { E_CONTROLLER_DIGITAL_LEFT,  Key::Left   },
+        { E_CONTROLLER_DIGITAL_UP,    Key::Up     },
+        { E_CONTROLLER_DIGITAL_DOWN,  Key::Down   },
+        { E_CONTROLLER_DIGITAL_R1,    Key::R      },
+        { E_CONTROLLER_DIGITAL_L1,    Key::L      }
+    };
+
+    u16 last = 0;
+
+    while (true) {
+        u16 keys = 0;
+
+        for (const auto& mapping : s_buttons) {
+            if (controller_get_digital(E_CONTROLLER_MASTER, mapping.button)) {
+                keys |= static_cast<u16>(mapping.key);
+            }
+        }
+
+        // only changes are queued, a full queue is retried on the next poll
+        if (keys != last && g_input.push(keys, millis())) {
+            last = keys;
+        }
+        delay(5);
+    }
 }
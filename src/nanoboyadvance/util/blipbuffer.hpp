@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "integer.hpp"
+
+namespace Util {
+
+    /// Band-limited synthesis of a signal that only changes in steps, after
+    /// Shay Green's blip_buf. Each step is added as an amplitude delta at its
+    /// clock time, which costs the same no matter how high the signal's
+    /// frequency is. Samples are integrated out of the buffer in bulk.
+    class BlipBuffer {
+    public:
+        /// @param  size  samples the buffer holds
+        BlipBuffer(int size);
+
+        /// Sets the clock rate deltas are timed in and the output sample rate.
+        void setRates(u32 clock_rate, u32 sample_rate);
+
+        /// Removes all samples and deltas.
+        void clear();
+
+        /// Adds an amplitude change.
+        /// @param  time   clocks since the start of the current frame
+        /// @param  delta  change of the amplitude
+        void addDelta(u32 time, int delta);
+
+        /// Ends the current frame, the samples before its end can then be read.
+        /// @param  clocks  length of the frame, the next one starts there
+        void endFrame(u32 clocks);
+
+        /// Samples that can be read.
+        int samplesAvailable() const { return m_avail; }
+
+        /// Samples that fit into the buffer, including those available.
+        int capacity() const { return m_size; }
+
+        /// Reads and removes up to count samples.
+        /// @returns  number of samples read
+        int readSamples(int* out, int count);
+
+        /// Removes up to count samples without returning them.
+        void removeSamples(int count);
+
+    private:
+        static constexpr int s_phase_bits = 5;
+        static constexpr int s_width      = 16;   // kernel taps
+        static constexpr int s_delta_bits = 15;   // each kernel phase sums to 1 << s_delta_bits
+
+        static const s16 s_kernel[1 << s_phase_bits][s_width];
+
+        int m_size;
+        int m_avail = 0;
+        int m_integrator = 0;
+
+        u64 m_factor = 0;  // samples per clock, 32.32 fixed point
+        u64 m_offset = 0;  // start of the current frame after the available samples
+
+        // deltas in sample time, integrated when read
+        std::vector<int> m_buffer;
+
+        void shiftOut(int count);
+    };
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "framepacer.hpp"
+
+#ifdef FRAMEPACER_STEADY_CLOCK
+#include <chrono>
+#endif
+
+namespace Util {
+
+    FramePacer::FramePacer(u32 (*clock_us)(), int max_frameskip) :
+            m_clock(clock_us),
+            m_max_interval(std::max(max_frameskip, 1))
+    {
+    }
+
+    void FramePacer::beginFrame() {
+        m_start = m_clock();
+        m_slept = 0;
+
+        // the first frame starts the schedule
+        if (!m_synced) {
+            m_deadline = m_start;
+            m_frac     = 0;
+            m_synced   = true;
+        }
+    }
+
+    u32 FramePacer::endFrame() {
+        u32 now = m_clock();
+
+        // exponential moving average over ~16 frames
+        m_average = m_average - (m_average >> 4) + (now - m_start - m_slept);
+
+        m_deadline += s_frame_us;
+        m_frac     += s_frame_frac;
+
+        if (m_frac >= 1000) {
+            m_frac -= 1000;
+            m_deadline++;
+        }
+
+        // unsigned difference, the clock may wrap around
+        s32 slack = static_cast<s32>(m_deadline - now);
+
+        if (slack < 0) {
+            m_early = 0;
+
+            if (m_interval < m_max_interval && ++m_late >= s_late_limit) {
+                m_interval++;
+                m_late = 0;
+            }
+
+            // too far behind to catch up without running in bursts, slow down instead
+            if (slack < -2 * static_cast<s32>(s_frame_us)) {
+                m_deadline = now;
+            }
+            return 0;
+        }
+
+        // on time frames make up for late ones, so that jitter does not add up
+        if (m_late > 0) {
+            m_late--;
+        }
+
+        // sleeps in the middle of the frame were slack as well
+        if (m_interval > 1 && slack + static_cast<s32>(m_slept) > static_cast<s32>(s_frame_us / 3)) {
+            if (++m_early >= s_early_limit) {
+                m_interval--;
+                m_early = 0;
+            }
+        } else {
+            m_early = 0;
+        }
+
+        return slack;
+    }
+
+    u32 FramePacer::timeUntil(int frame_cycles) const {
+        u32 due = m_deadline + static_cast<u32>(static_cast<u64>(frame_cycles) * s_frame_us / s_frame_cycles);
+
+        s32 left = static_cast<s32>(due - m_clock());
+
+        return (left > 0) ? left : 0;
+    }
+
+    void FramePacer::resync() {
+        m_synced = false;
+        m_late   = 0;
+        m_early  = 0;
+    }
+
+#ifdef FRAMEPACER_STEADY_CLOCK
+    u32 FramePacer::steadyClock() {
+        using namespace std::chrono;
+
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+#endif
+}
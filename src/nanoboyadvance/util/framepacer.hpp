@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "integer.hpp"
+
+#if defined(__linux__) || defined(_WIN32) || defined(__APPLE__)
+    #define FRAMEPACER_STEADY_CLOCK
+#endif
+
+namespace Util {
+
+    /// Keeps the emulation at the GBA's refresh rate (~59.73 Hz).
+    /// Each frame is given an absolute deadline, so sleeping only covers the
+    /// slack that is left and a late frame is made up for by the next ones.
+    /// If frames keep missing their deadline the frameskip is raised (the CPU,
+    /// timers and audio still run every frame), with plenty of slack over a
+    /// few seconds it is lowered again.
+    class FramePacer {
+    public:
+        /// @param  clock_us       microsecond clock, any start value and resolution
+        /// @param  max_frameskip  highest frameskip to fall back to
+        FramePacer(u32 (*clock_us)(), int max_frameskip = 4);
+
+        /// Starts the time measurement of a frame (emulation and presentation).
+        void beginFrame();
+
+        /// Ends the frame and adapts the frameskip.
+        /// @returns  microseconds to sleep before the next frame
+        u32 endFrame();
+
+        /// Microseconds until a point of the current frame is due, 0 if it is late.
+        /// @param  frame_cycles  cycles since the start of the frame
+        u32 timeUntil(int frame_cycles) const;
+
+        /// Tells the pacer about a sleep in the middle of a frame. That time was
+        /// to spare and does not count against the frameskip.
+        void slept(u32 us) { m_slept += us; }
+
+        /// Frameskip in the sense of Config::frameskip (0 = draw every frame).
+        int frameskip() const { return m_interval == 1 ? 0 : m_interval; }
+
+        /// Average time spent on a frame in microseconds.
+        u32 averageFrameTime() const { return m_average >> 4; }
+
+        /// Forgets the deadline, e.g. after the emulation was paused.
+        void resync();
+
+    #ifdef FRAMEPACER_STEADY_CLOCK
+        /// std::chrono::steady_clock in microseconds.
+        static u32 steadyClock();
+    #endif
+
+    private:
+        // 280896 cycles at 16.78 MHz = 16742.706 us
+        static constexpr u32 s_frame_cycles = 280896;
+        static constexpr u32 s_frame_us     = 16742;
+        static constexpr u32 s_frame_frac   = 706;  // nanoseconds
+
+        // late frames (net) before the frameskip goes up
+        static constexpr int s_late_limit = 8;
+
+        // frames with a third of the frame time to spare before it goes down
+        static constexpr int s_early_limit = 180;
+
+        u32 (*m_clock)();
+
+        int m_interval = 1;  // frames per drawn frame
+        int m_max_interval;
+
+        u32 m_start;
+        u32 m_deadline;
+        u32 m_frac = 0;
+        u32 m_slept = 0;     // sleeps within the current frame
+        bool m_synced = false;
+
+        u32 m_average = 0;   // 28.4 fixed point
+        int m_late    = 0;
+        int m_early   = 0;
+    };
+}
@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <algorithm>
+#include "scaler.hpp"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCALER_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCALER_SSE2
+#endif
+
+namespace Util {
+
+    void Scaler::configure(int src_width, int src_height, int dst_width, int dst_height, Mode mode) {
+        m_src_width  = src_width;
+        m_src_height = src_height;
+
+        switch (mode) {
+            case Mode::Stretch: {
+                m_width  = dst_width;
+                m_height = dst_height;
+                break;
+            }
+            case Mode::Integer: {
+                int factor = std::min(dst_width / src_width, dst_height / src_height);
+
+                if (factor >= 1) {
+                    m_width  = src_width  * factor;
+                    m_height = src_height * factor;
+                    break;
+                }
+                // the picture does not fit at 1x, scale it down instead
+                [[fallthrough]];
+            }
+            case Mode::Aspect: {
+                if (dst_width * src_height <= dst_height * src_width) {
+                    m_width  = dst_width;
+                    m_height = dst_width * src_height / src_width;
+                } else {
+                    m_width  = dst_height * src_width / src_height;
+                    m_height = dst_height;
+                }
+                break;
+            }
+        }
+
+        m_x = (dst_width  - m_width ) / 2;
+        m_y = (dst_height - m_height) / 2;
+
+        m_column.resize(m_width);
+        m_row.resize(src_height + 1);
+
+        for (int x = 0; x < m_width; x++) {
+            m_column[x] = x * src_width / m_width;
+        }
+
+        // destination row y shows source line (y * src_height / m_height)
+        for (int line = 0; line <= src_height; line++) {
+            m_row[line] = (line * m_height + src_height - 1) / src_height;
+        }
+
+        if (m_width == src_width) {
+            m_kernel = Kernel::Copy;
+        } else if (m_width == src_width * 2) {
+            m_kernel = Kernel::Double;
+        } else if (m_width * 2 == src_width * 3 && (src_width % 8) == 0) {
+            m_kernel = Kernel::ThreeHalves;
+        } else {
+            m_kernel = Kernel::Lookup;
+        }
+    }
+
+    void Scaler::scaleRow(const u32* src, u32* dst) const {
+        switch (m_kernel) {
+            case Kernel::Copy: {
+                memcpy(dst, src, m_width * sizeof(u32));
+                break;
+            }
+            case Kernel::Double: {
+                int x = 0;
+            #if defined(SCALER_NEON)
+                for (; x + 4 <= m_src_width; x += 4) {
+                    uint32x4_t  v = vld1q_u32(src + x);
+                    uint32x4x2_t z = { { v, v } };
+
+                    vst2q_u32(dst + x * 2, z);
+                }
+            #elif defined(SCALER_SSE2)
+                for (; x + 4 <= m_src_width; x += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+
+                    _mm_storeu_si128((__m128i*)(dst + x * 2 + 0), _mm_unpacklo_epi32(v, v));
+                    _mm_storeu_si128((__m128i*)(dst + x * 2 + 4), _mm_unpackhi_epi32(v, v));
+                }
+            #endif
+                for (; x < m_src_width; x++) {
+                    dst[x * 2 + 0] = src[x];
+                    dst[x * 2 + 1] = src[x];
+                }
+                break;
+            }
+            case Kernel::ThreeHalves: {
+                // every 8 source pixels a..h become a a b c c d e e f g g h
+            #if defined(SCALER_NEON)
+                for (int x = 0; x < m_src_width; x += 8) {
+                    uint32x4_t v0 = vld1q_u32(src + x + 0);
+                    uint32x4_t v1 = vld1q_u32(src + x + 4);
+                    uint32x2_t lo = vget_low_u32 (v1);
+                    uint32x2_t hi = vget_high_u32(v1);
+                    u32* out = dst + x + (x >> 1);
+
+                    vst1q_u32(out + 0, vextq_u32(vdupq_lane_u32(vget_low_u32(v0), 0), v0, 3));
+                    vst1q_u32(out + 4, vcombine_u32(vget_high_u32(v0), vdup_lane_u32(lo, 0)));
+                    vst1q_u32(out + 8, vcombine_u32(vext_u32(lo, hi, 1), hi));
+                }
+            #elif defined(SCALER_SSE2)
+                for (int x = 0; x < m_src_width; x += 8) {
+                    __m128i v0 = _mm_loadu_si128((const __m128i*)(src + x + 0));
+                    __m128i v1 = _mm_loadu_si128((const __m128i*)(src + x + 4));
+                    __m128i e  = _mm_shuffle_epi32(v1, _MM_SHUFFLE(0, 0, 0, 0));
+                    u32* out = dst + x + (x >> 1);
+
+                    _mm_storeu_si128((__m128i*)(out + 0), _mm_shuffle_epi32(v0, _MM_SHUFFLE(2, 1, 0, 0)));
+                    _mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi64(v0, e));
+                    _mm_storeu_si128((__m128i*)(out + 8), _mm_shuffle_epi32(v1, _MM_SHUFFLE(3, 2, 2, 1)));
+                }
+            #else
+                for (int x = 0; x < m_src_width; x += 2) {
+                    u32* out = dst + x + (x >> 1);
+
+                    out[0] = src[x + 0];
+                    out[1] = src[x + 0];
+                    out[2] = src[x + 1];
+                }
+            #endif
+                break;
+            }
+            case Kernel::Lookup: {
+                const u16* column = m_column.data();
+
+                for (int x = 0; x < m_width; x++) {
+                    dst[x] = src[column[x]];
+                }
+                break;
+            }
+        }
+    }
+
+    void Scaler::scaleLine(const u32* src, int line, u32* dst, int stride) const {
+        int first = m_row[line];
+        int count = m_row[line + 1] - first;
+
+        if (count == 0) {
+            return;
+        }
+
+        u32* row = dst + (m_y + first) * stride + m_x;
+
+        scaleRow(src, row);
+
+        // duplicated rows are plain copies of the first one
+        for (int i = 1; i < count; i++) {
+            memcpy(row + i * stride, row, m_width * sizeof(u32));
+        }
+    }
+
+    void Scaler::scaleFrame(const u32* src, u32* dst, int stride) const {
+        for (int line = 0; line < m_src_height; line++) {
+            scaleLine(src + line * m_src_width, line, dst, stride);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "integer.hpp"
+
+namespace Util {
+
+    /// Nearest neighbour scaler for 32-bit pixels.
+    /// All source-to-destination mapping is computed once in configure(),
+    /// so scaling is a table lookup (or a SIMD kernel for 1x, 1.5x and 2x)
+    /// for the first copy of a row and a memcpy for each duplicate.
+    class Scaler {
+    public:
+        enum class Mode {
+            Stretch, ///< fill the whole destination area
+            Aspect,  ///< keep the aspect ratio, letterbox the rest
+            Integer  ///< largest integer factor that fits, letterbox the rest
+        };
+
+        /// Sets up the mapping of a picture onto a destination area.
+        /// @param  src_width   width of the source picture
+        /// @param  src_height  height of the source picture
+        /// @param  dst_width   width of the destination area
+        /// @param  dst_height  height of the destination area
+        /// @param  mode        how to fit the picture into the area
+        void configure(int src_width, int src_height, int dst_width, int dst_height, Mode mode);
+
+        /// Scales one source line into all destination rows it covers.
+        /// @param  src     the source line
+        /// @param  line    index of the source line
+        /// @param  dst     top-left pixel of the destination area
+        /// @param  stride  distance between two destination rows, in pixels
+        void scaleLine(const u32* src, int line, u32* dst, int stride) const;
+
+        /// Scales a whole picture with a stride of src_width pixels.
+        void scaleFrame(const u32* src, u32* dst, int stride) const;
+
+        /// Position and size of the scaled picture inside the destination area.
+        int x() const { return m_x; }
+        int y() const { return m_y; }
+        int width()  const { return m_width;  }
+        int height() const { return m_height; }
+
+        /// First destination row covered by a source line (line = src_height is the end).
+        int rowOf(int line) const { return m_y + m_row[line]; }
+
+    private:
+        enum class Kernel {
+            Copy,
+            Double,
+            ThreeHalves,
+            Lookup
+        };
+
+        int m_src_width  = 0;
+        int m_src_height = 0;
+
+        int m_x = 0;
+        int m_y = 0;
+        int m_width  = 0;
+        int m_height = 0;
+
+        Kernel m_kernel = Kernel::Lookup;
+
+        std::vector<u16> m_column; // source column of each destination column
+        std::vector<int> m_row;    // first destination row of each source line
+
+        void scaleRow(const u32* src, u32* dst) const;
+    };
+}
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace Util {
+
+    /// Lock-free FIFO for exactly one producer and one consumer thread.
+    /// Neither side ever blocks; push() fails when the queue is full and
+    /// pop() fails when it is empty.
+    template <typename T, std::size_t capacity>
+    class SPSCQueue {
+        static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        /// Appends an item (producer only).
+        /// @returns  false if the queue is full
+        bool push(const T& item) {
+            std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+            if (tail - m_head.load(std::memory_order_acquire) == capacity) {
+                return false;
+            }
+            m_items[tail & (capacity - 1)] = item;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Removes the oldest item (consumer only).
+        /// @returns  false if the queue is empty
+        bool pop(T& item) {
+            std::size_t head = m_head.load(std::memory_order_relaxed);
+
+            if (head == m_tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = m_items[head & (capacity - 1)];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Number of queued items, exact only when called from either end.
+        std::size_t size() const {
+            return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+    private:
+        // keep both indices on their own cache line
+        alignas(64) std::atomic<std::size_t> m_head { 0 };
+        alignas(64) std::atomic<std::size_t> m_tail { 0 };
+
+        T m_items[capacity];
+    };
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+//  NanoboyAdvance is a modern Game Boy Advance emulator written in C++
+//  with performance, platform independency and reasonable accuracy in mind.
+//  Copyright (C) 2017 Frederic Meyer
+//
+//  This file is part of nanoboyadvance.
+//
+//  nanoboyadvance is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  nanoboyadvance is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with nanoboyadvance. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include "integer.hpp"
+
+namespace Util {
+
+    /// Lock-free triple buffer for exactly one producer and one consumer thread.
+    /// The producer fills back() and publishes it, the consumer takes the most
+    /// recently published item with acquire() and reads front(). Neither side
+    /// ever waits; an item that was not taken yet is replaced by the next one.
+    /// The consumer never writes, so the producer may still read earlier items,
+    /// e.g. to carry over the parts that did not change.
+    template <typename T>
+    class TripleBuffer {
+    public:
+        /// The item being filled (producer only).
+        T& back() { return m_items[m_back]; }
+
+        /// The item last taken by acquire() (consumer only).
+        const T& front() const { return m_items[m_front]; }
+
+        /// Hands back() over to the consumer and starts on another item (producer only).
+        void publish() {
+            u8 middle = m_middle.exchange(m_back | s_fresh, std::memory_order_acq_rel);
+            m_back = middle & s_index;
+        }
+
+        /// Takes the most recently published item if there is one (consumer only).
+        /// @returns  true if front() changed
+        bool acquire() {
+            if (!(m_middle.load(std::memory_order_relaxed) & s_fresh)) {
+                return false;
+            }
+            u8 middle = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = middle & s_index;
+            return true;
+        }
+
+    private:
+        static constexpr u8 s_index = 3;
+        static constexpr u8 s_fresh = 4;
+
+        T m_items[3];
+
+        u8 m_back  = 0;
+        u8 m_front = 1;
+
+        std::atomic<u8> m_middle { 2 };
+    };
+}